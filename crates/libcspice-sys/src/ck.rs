@@ -0,0 +1,446 @@
+//! Batched CK attitude lookup, for reconstructing pointing histories.
+//!
+//! Each `ckgp_c` call searches the loaded CK files, segment by segment and in order of priority,
+//! for pointing of the instrument, and then searches the segment's record times and interpolation
+//! intervals for the time, under the global state of CSPICE. Reconstructing the pointing of every
+//! sample of an observation pays for these searches (and the serialization) on every sample.
+//!
+//! A [`CkIndex`] reads the segments of a set of CK files into memory once. A batch of sorted
+//! times is then served by a single forward walk over the record times of the segments, with
+//! the rotations interpolated in pure Rust, as `ckgp_c` / `ckgpav_c` would. The index can be
+//! shared by any number of threads, and [`CkIndex::par_pointing_into`] splits a batch into
+//! disjoint time ranges, which are walked in parallel.
+//!
+//! Times are given as encoded spacecraft clock (ticks), as for `ckgp_c`, and the tolerance is
+//! applied the same way: pointing from the nearest record within the tolerance, when the time
+//! is not inside an interpolation interval. [`sclk_ticks`] converts ET times to ticks via
+//! `sce2c_c`.
+//!
+//! Only the discrete (type 1) and linearly interpolated (type 3) segments, which hold most
+//! reconstructed attitude, are evaluated. Queries that need segments of other types return
+//! [`CkError::UnsupportedType`], so the caller may fall back to `ckgp_c` for those. The pointing
+//! is returned relative to the reference frame of the segment, e.g. to be combined with the
+//! rotations of the [`frames`](crate::frames) module if other frames are needed.
+//!
+//! ```no_run
+//! use libcspice_sys::ck::{sclk_ticks, CkIndex};
+//!
+//! // Index the CK kernels loaded via furnsh_c()...
+//! let index = CkIndex::from_loaded().unwrap();
+//!
+//! // One day of 1 Hz samples of instrument -82000, to ticks of spacecraft -82's clock.
+//! let et: Vec<f64> = (0..86400).map(|i| i as f64).collect();
+//! let mut sclk = vec![0.0; et.len()];
+//! sclk_ticks(-82, &et, &mut sclk).unwrap();
+//!
+//! let mut pointing = vec![None; et.len()];
+//! index.par_pointing_into(-82000, &sclk, 0.0, &mut pointing, 0).unwrap();
+//!
+//! // The C-matrix of the first sample, rotating vectors from the segment's frame into the
+//! // instrument frame.
+//! let cmat = pointing[0].unwrap().matrix();
+//! ```
+
+use std::collections::HashMap;
+use std::ffi::CStr;
+use std::fmt;
+use std::fs;
+use std::path::Path;
+use std::thread;
+
+use crate::{daf, failed_c, reset_c, sce2c_c, SpiceBoolean, SpiceDouble, SpiceInt, SPICEFALSE};
+
+/// NAIF kernel type of the kernels to index.
+const CK_KERNELS: &CStr = c"CK";
+
+/// Number of record times (or interval starts) per directory entry of a segment.
+const DIRECTORY: usize = 100;
+
+/// Number of record times stepped through one by one, before a binary search of the rest.
+const LINEAR_STEPS: usize = 8;
+
+/// Smallest number of times processed by one thread, below which batches are not split further.
+const MIN_CHUNK: usize = 4096;
+
+/// Errors from building, or querying, a CK index.
+#[derive(Debug)]
+pub enum CkError {
+    /// Reading a CK file failed.
+    Io(std::io::Error),
+    /// The file is not a (valid) CK file.
+    Format(String),
+    /// The segment needed for the query is of a CK type that is not evaluated by the index.
+    UnsupportedType(i32),
+    /// CSPICE signaled an error, e.g. for lack of SCLK data to convert times.
+    Spice,
+}
+
+impl fmt::Display for CkError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            CkError::Io(e) => write!(f, "CK I/O error: {}", e),
+            CkError::Format(msg) => write!(f, "invalid CK file: {}", msg),
+            CkError::UnsupportedType(t) => write!(f, "CK segment type {} is not supported by the index", t),
+            CkError::Spice => write!(f, "CSPICE error while converting times to SCLK"),
+        }
+    }
+}
+
+impl std::error::Error for CkError {}
+
+impl From<std::io::Error> for CkError {
+    fn from(e: std::io::Error) -> Self {
+        CkError::Io(e)
+    }
+}
+
+/// The pointing of an instrument at a time.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Pointing {
+    /// The rotation from the reference frame to the instrument frame, as a SPICE-style unit
+    /// quaternion, with the scalar component first.
+    pub quat: [f64; 4],
+    /// [rad/s] The angular velocity of the instrument, in the reference frame, if the segment
+    /// holds angular velocities.
+    pub av: Option<[f64; 3]>,
+    /// [ticks] The time (encoded SCLK) of the pointing, which is the requested time, or else
+    /// the time of the nearest record within the tolerance.
+    pub clkout: f64,
+    /// NAIF ID of the reference frame.
+    pub frame: i32,
+}
+
+impl Pointing {
+    /// The C-matrix, which rotates vectors from the reference frame to the instrument frame, as
+    /// `q2m_c` would return it. It can be used as the rotation matrix of a coordinate transform
+    /// directly, e.g. from ICRS / J2000 to instrument coordinates.
+    pub fn matrix(&self) -> [[f64; 3]; 3] {
+        let n = self.quat.iter().map(|q| q * q).sum::<f64>();
+        let s = if n > 0.0 { 2.0 / n } else { 0.0 };
+        let [q0, q1, q2, q3] = self.quat;
+
+        [
+            [1.0 - s * (q2 * q2 + q3 * q3), s * (q1 * q2 - q0 * q3), s * (q1 * q3 + q0 * q2)],
+            [s * (q1 * q2 + q0 * q3), 1.0 - s * (q1 * q1 + q3 * q3), s * (q2 * q3 - q0 * q1)],
+            [s * (q1 * q3 - q0 * q2), s * (q2 * q3 + q0 * q1), 1.0 - s * (q1 * q1 + q2 * q2)],
+        ]
+    }
+}
+
+/// A segment of a CK file.
+#[derive(Debug, Clone)]
+struct Segment {
+    /// Index of the file, in the index.
+    file: usize,
+    frame: i32,
+    kind: i32,
+    /// Whether the records hold angular velocities.
+    av: bool,
+    /// [ticks] Start of the segment's coverage.
+    start: f64,
+    /// [ticks] End of the segment's coverage.
+    stop: f64,
+    /// Word address (0-based) of the first record.
+    records: usize,
+    /// Word address (0-based) of the first record time.
+    times: usize,
+    /// Number of records.
+    n: usize,
+    /// Word address (0-based) of the first interval start (type 3 only).
+    intervals: usize,
+    /// Number of interpolation intervals (type 3 only).
+    nint: usize,
+}
+
+impl Segment {
+    /// Number of doubles per record.
+    fn record_size(&self) -> usize {
+        if self.av { 7 } else { 4 }
+    }
+}
+
+/// An index of the segments of a set of CK files, for batched lookups of instrument pointing.
+#[derive(Debug, Default)]
+pub struct CkIndex {
+    /// The contents of the files, as doubles in native byte order.
+    files: Vec<Vec<f64>>,
+    segments: Vec<Segment>,
+    /// Segments in order of priority (highest first), by instrument.
+    instruments: HashMap<i32, Vec<usize>>,
+}
+
+/// Positions reached in the record times and interval starts of a segment, from which the
+/// search for the next (later) time starts.
+#[derive(Debug, Clone, Copy, Default)]
+struct Cursor {
+    record: usize,
+    interval: usize,
+}
+
+/// Returns the number of values in sorted `xs` that are not after `t`, starting the search at
+/// `from` (a previous result for an earlier time), with a few linear steps before bisecting.
+fn seek(xs: &[f64], from: usize, t: f64) -> usize {
+    let from = if from > 0 && from <= xs.len() && xs[from - 1] <= t { from } else { 0 };
+    let linear = (from + LINEAR_STEPS).min(xs.len());
+
+    for k in from..linear {
+        if xs[k] > t {
+            return k;
+        }
+    }
+
+    linear + xs[linear..].partition_point(|&x| x <= t)
+}
+
+/// Parses the contents of a DAF/CK file, returning its contents as doubles, and its segments,
+/// with the NAIF IDs of their instruments, in file order.
+fn parse_ck(name: &str, bytes: &[u8], file: usize) -> Result<(Vec<f64>, Vec<(i32, Segment)>), CkError> {
+    let (words, summaries) = daf::parse(name, bytes, b"DAF/CK  ").map_err(CkError::Format)?;
+    let mut segments = Vec::with_capacity(summaries.len());
+
+    for s in summaries {
+        let [inst, frame, kind, av, _, _] = s.ic;
+        let mut seg = Segment {
+            file, frame, kind, av: av != 0, start: s.dc[0], stop: s.dc[1],
+            records: s.begin, times: s.begin, n: 0, intervals: s.begin, nint: 0,
+        };
+
+        // Type 1: records, times, time directory, N.
+        // Type 3: records, times, time directory, interval starts, interval directory, NINT, N.
+        // Segments of other types are kept, and reported as unsupported if they are needed.
+        let data = &words[s.begin..s.end];
+        let counts = match kind {
+            1 => data.last().map(|&n| (0.0, n)),
+            3 if data.len() >= 2 => Some((data[data.len() - 2], data[data.len() - 1])),
+            _ => None,
+        };
+
+        if let Some((nint, n)) = counts {
+            let bad = || CkError::Format(format!("{}: corrupt type {} segment for instrument {}", name, kind, inst));
+            if !(n >= 1.0 && nint >= 0.0 && n <= data.len() as f64 && nint <= data.len() as f64) {
+                return Err(bad());
+            }
+
+            let (n, nint) = (n as usize, nint as usize);
+            let header = if kind == 1 { 1 } else { 2 };
+            let size = n * (seg.record_size() + 1) + (n - 1) / DIRECTORY
+                + if kind == 3 { nint + nint.saturating_sub(1) / DIRECTORY } else { 0 };
+            if (kind == 3 && nint == 0) || size + header != data.len() {
+                return Err(bad());
+            }
+
+            seg.n = n;
+            seg.nint = nint;
+            seg.times = seg.records + n * seg.record_size();
+            seg.intervals = seg.times + n + (n - 1) / DIRECTORY;
+        }
+
+        segments.push((inst, seg));
+    }
+
+    Ok((words, segments))
+}
+
+/// Interpolates between unit quaternions along the shortest arc, as `ckgp_c` rotates between the
+/// C-matrices of the bracketing records of type 3 segments.
+fn slerp(q0: &[f64], q1: &[f64], f: f64) -> [f64; 4] {
+    let mut dot = (0..4).map(|i| q0[i] * q1[i]).sum::<f64>();
+    let sign = if dot < 0.0 { -1.0 } else { 1.0 };
+    dot = (sign * dot).min(1.0);
+
+    let theta = dot.acos();
+    let (a, b) = if theta < 1e-9 {
+        (1.0 - f, f)
+    } else {
+        let s = theta.sin();
+        (((1.0 - f) * theta).sin() / s, (f * theta).sin() / s)
+    };
+
+    let q: [f64; 4] = std::array::from_fn(|i| a * q0[i] + sign * b * q1[i]);
+    let norm = q.iter().map(|x| x * x).sum::<f64>().sqrt();
+    q.map(|x| x / norm)
+}
+
+impl CkIndex {
+    /// Indexes the CK kernels loaded in CSPICE (via `furnsh_c`), with the same priorities.
+    pub fn from_loaded() -> Result<CkIndex, CkError> {
+        CkIndex::open(&daf::loaded(CK_KERNELS))
+    }
+
+    /// Indexes CK files, given in load order, i.e. later files take priority over earlier ones
+    /// where they overlap.
+    pub fn open<P: AsRef<Path>>(paths: &[P]) -> Result<CkIndex, CkError> {
+        let mut index = CkIndex::default();
+        let mut segments = Vec::new();
+
+        for (file, path) in paths.iter().enumerate() {
+            let bytes = fs::read(path)?;
+            let (words, s) = parse_ck(&path.as_ref().display().to_string(), &bytes, file)?;
+            index.files.push(words);
+            segments.push(s);
+        }
+
+        // Order of priority: last file first, and last segment first within it.
+        for (inst, s) in segments.into_iter().rev().flat_map(|s| s.into_iter().rev()) {
+            index.instruments.entry(inst).or_default().push(index.segments.len());
+            index.segments.push(s);
+        }
+
+        Ok(index)
+    }
+
+    /// The number of indexed segments.
+    pub fn len(&self) -> usize {
+        self.segments.len()
+    }
+
+    /// Whether there are no indexed segments.
+    pub fn is_empty(&self) -> bool {
+        self.segments.is_empty()
+    }
+
+    /// The NAIF IDs of the indexed instruments.
+    pub fn instruments(&self) -> Vec<i32> {
+        let mut ids: Vec<i32> = self.instruments.keys().copied().collect();
+        ids.sort_unstable();
+        ids
+    }
+
+    /// The pointing from a segment at `t` (ticks), if it has pointing within `tol` ticks.
+    fn evaluate(&self, seg: &Segment, t: f64, tol: f64, cursor: &mut Cursor) -> Result<Option<Pointing>, CkError> {
+        if seg.kind != 1 && seg.kind != 3 {
+            return Err(CkError::UnsupportedType(seg.kind));
+        }
+
+        let data = &self.files[seg.file];
+        let size = seg.record_size();
+        let times = &data[seg.times..seg.times + seg.n];
+        let record = |k: usize| &data[seg.records + k * size..seg.records + (k + 1) * size];
+        let pointing = |quat: [f64; 4], av: Option<[f64; 3]>, clkout: f64| Pointing { quat, av, clkout, frame: seg.frame };
+        let rates = |r: &[f64]| seg.av.then(|| [r[4], r[5], r[6]]);
+
+        // k is the first record after t.
+        let k = seek(times, cursor.record, t);
+        cursor.record = k;
+
+        let inside = t >= seg.start && t <= seg.stop;
+
+        // Interpolate between the bracketing records, if both are in the interval containing t.
+        if seg.kind == 3 && inside && k > 0 && k < seg.n && times[k - 1] < t {
+            let starts = &data[seg.intervals..seg.intervals + seg.nint];
+            let j = seek(starts, cursor.interval, t);
+            cursor.interval = j;
+
+            if j > 0 && times[k - 1] >= starts[j - 1] && (j == seg.nint || times[k] < starts[j]) {
+                let (r0, r1) = (record(k - 1), record(k));
+                let f = (t - times[k - 1]) / (times[k] - times[k - 1]);
+                let av = seg.av.then(|| std::array::from_fn(|i| r0[4 + i] + f * (r1[4 + i] - r0[4 + i])));
+                return Ok(Some(pointing(slerp(&r0[..4], &r1[..4], f), av, t)));
+            }
+        }
+
+        // Otherwise, the nearest record within the tolerance and the segment's coverage (the
+        // record at t itself, if there is one).
+        let nearest = [k.checked_sub(1), (k < seg.n).then_some(k)]
+            .into_iter()
+            .flatten()
+            .filter(|&i| (times[i] - t).abs() <= tol && times[i] >= seg.start && times[i] <= seg.stop)
+            .min_by(|&a, &b| (times[a] - t).abs().total_cmp(&(times[b] - t).abs()));
+
+        Ok(nearest.map(|i| {
+            let r = record(i);
+            pointing([r[0], r[1], r[2], r[3]], rates(r), times[i])
+        }))
+    }
+
+    /// The pointing of the instrument at times `sclk` (ticks), which must be sorted in increasing
+    /// order, from the highest priority segment having pointing within `tol` ticks of each time,
+    /// like `ckgp_c` (or `ckgpav_c`, for segments with angular velocities). The segments are walked
+    /// forward once, for the batch. Times without pointing get `None` in `pointing`.
+    ///
+    /// Returns the number of times with pointing.
+    ///
+    /// # Panics
+    ///
+    /// If the slices differ in length.
+    pub fn pointing_into(&self, inst: i32, sclk: &[f64], tol: f64, pointing: &mut [Option<Pointing>])
+                         -> Result<usize, CkError> {
+        assert!(pointing.len() == sclk.len(), "time and pointing arrays differ in length");
+
+        let Some(ids) = self.instruments.get(&inst) else {
+            pointing.fill(None);
+            return Ok(0);
+        };
+
+        let mut cursors = vec![Cursor::default(); ids.len()];
+        let mut found = 0;
+
+        for (&t, out) in sclk.iter().zip(pointing.iter_mut()) {
+            *out = None;
+
+            for (&id, cursor) in ids.iter().zip(cursors.iter_mut()) {
+                let seg = &self.segments[id];
+                if t + tol < seg.start || t - tol > seg.stop {
+                    continue;
+                }
+                if let Some(p) = self.evaluate(seg, t, tol, cursor)? {
+                    *out = Some(p);
+                    found += 1;
+                    break;
+                }
+            }
+        }
+
+        Ok(found)
+    }
+
+    /// The pointing of the instrument at a single time (ticks), as for [`CkIndex::pointing_into`].
+    pub fn pointing(&self, inst: i32, sclk: f64, tol: f64) -> Result<Option<Pointing>, CkError> {
+        let mut p = [None];
+        self.pointing_into(inst, &[sclk], tol, &mut p)?;
+        Ok(p[0])
+    }
+
+    /// Same as [`CkIndex::pointing_into`], but walks disjoint time ranges of the batch on `threads`
+    /// threads (or on all available cores, if 0).
+    pub fn par_pointing_into(&self, inst: i32, sclk: &[f64], tol: f64, pointing: &mut [Option<Pointing>],
+                             threads: usize) -> Result<usize, CkError> {
+        assert!(pointing.len() == sclk.len(), "time and pointing arrays differ in length");
+
+        let threads = if threads > 0 { threads } else { thread::available_parallelism().map_or(1, |n| n.get()) };
+        let chunk = sclk.len().div_ceil(threads).max(MIN_CHUNK);
+
+        thread::scope(|s| {
+            let workers: Vec<_> = sclk.chunks(chunk).zip(pointing.chunks_mut(chunk))
+                .map(|(t, p)| s.spawn(move || self.pointing_into(inst, t, tol, p)))
+                .collect();
+
+            workers.into_iter().map(|w| w.join().unwrap()).sum()
+        })
+    }
+}
+
+/// Converts ET times (TDB seconds past J2000) to encoded SCLK (ticks) of a spacecraft clock, via
+/// `sce2c_c`, for the SCLK kernel loaded. The clock ID of an instrument is usually its NAIF ID
+/// divided by 1000 (e.g. -82 for instrument -82000).
+///
+/// # Panics
+///
+/// If the slices differ in length.
+pub fn sclk_ticks(sc: i32, et: &[f64], sclk: &mut [f64]) -> Result<(), CkError> {
+    assert!(sclk.len() == et.len(), "time arrays differ in length");
+
+    for (&t, out) in et.iter().zip(sclk.iter_mut()) {
+        let mut ticks: SpiceDouble = 0.0;
+        unsafe { sce2c_c(sc as SpiceInt, t, &mut ticks) };
+
+        if unsafe { failed_c() } != SPICEFALSE as SpiceBoolean {
+            unsafe { reset_c() };
+            return Err(CkError::Spice);
+        }
+
+        *out = ticks;
+    }
+
+    Ok(())
+}
@@ -0,0 +1,136 @@
+//! Reading of DAF (Double precision Array File) kernels, such as SPK and CK files, into memory.
+//!
+//! The segment indexes of the [`spk`](crate::spk) and [`ck`](crate::ck) modules read the files
+//! once, as doubles in native byte order, and look up the segment data by word address.
+
+use std::ffi::CStr;
+use std::os::raw::c_char;
+
+use crate::{kdata_c, ktotal_c, SpiceBoolean, SpiceInt, SPICEFALSE};
+
+/// Bytes per DAF record.
+const RECORD: usize = 1024;
+
+/// A segment summary of a DAF file with ND=2, NI=6 (as used by SPK and CK files).
+pub(crate) struct Summary {
+    /// The double precision components, i.e. the start and stop times of the segment.
+    pub dc: [f64; 2],
+    /// The integer components. The last two (the segment addresses) are given by `begin`, `end`.
+    pub ic: [i32; 6],
+    /// Word address (0-based) of the first double of the segment data.
+    pub begin: usize,
+    /// Word address (0-based) after the last double of the segment data.
+    pub end: usize,
+}
+
+/// Returns the paths of the kernels of a type (e.g. `c"SPK"`) loaded in CSPICE (via `furnsh_c`),
+/// in load order.
+pub(crate) fn loaded(kind: &CStr) -> Vec<String> {
+    let mut count: SpiceInt = 0;
+    unsafe { ktotal_c(kind.as_ptr(), &mut count) };
+
+    (0..count)
+        .filter_map(|i| {
+            let mut file = vec![0 as c_char; 1024];
+            let mut filtyp = [0 as c_char; 32];
+            let mut source = vec![0 as c_char; 1024];
+            let mut handle: SpiceInt = 0;
+            let mut found: SpiceBoolean = SPICEFALSE as SpiceBoolean;
+
+            unsafe {
+                kdata_c(i, kind.as_ptr(), file.len() as SpiceInt, filtyp.len() as SpiceInt,
+                        source.len() as SpiceInt, file.as_mut_ptr(), filtyp.as_mut_ptr(), source.as_mut_ptr(),
+                        &mut handle, &mut found);
+            }
+
+            (found != SPICEFALSE as SpiceBoolean)
+                .then(|| unsafe { CStr::from_ptr(file.as_ptr()) }.to_string_lossy().into_owned())
+        })
+        .collect()
+}
+
+/// Parses the contents of a DAF file of the given ID word (e.g. `b"DAF/SPK "`, or the older
+/// `b"NAIF/DAF"`, which is always accepted), returning its contents as doubles, and its segment
+/// summaries in file order. Errors are described by a message, prefixed with the file name.
+pub(crate) fn parse(name: &str, bytes: &[u8], id: &[u8; 8]) -> Result<(Vec<f64>, Vec<Summary>), String> {
+    let bad = |msg: &str| format!("{}: {}", name, msg);
+
+    if bytes.len() < RECORD || bytes.len() % 8 != 0 {
+        return Err(bad("truncated file"));
+    }
+
+    let file_id = &bytes[0..8];
+    if file_id != id && file_id != b"NAIF/DAF" {
+        return Err(bad(&format!("not a {} file", String::from_utf8_lossy(id).trim_end())));
+    }
+
+    // Byte order, from the format string, or else (for old files) from a sensible ND, NI
+    let int_at = |off: usize, big: bool| {
+        let b: [u8; 4] = bytes[off..off + 4].try_into().unwrap();
+        if big { i32::from_be_bytes(b) } else { i32::from_le_bytes(b) }
+    };
+    let big = match &bytes[88..96] {
+        b"BIG-IEEE" => true,
+        b"LTL-IEEE" => false,
+        _ => int_at(8, true) == 2 && int_at(12, true) == 6,
+    };
+
+    let (nd, ni) = (int_at(8, big), int_at(12, big));
+    if nd != 2 || ni != 6 {
+        return Err(bad(&format!("unexpected summary format ND={}, NI={}", nd, ni)));
+    }
+
+    let words: Vec<f64> = bytes.chunks_exact(8)
+        .map(|c| {
+            let b: [u8; 8] = c.try_into().unwrap();
+            if big { f64::from_be_bytes(b) } else { f64::from_le_bytes(b) }
+        })
+        .collect();
+
+    // Integer components of summaries are packed in pairs into doubles, in file byte order.
+    let ints = |w: f64| {
+        let b = if big { w.to_be_bytes() } else { w.to_le_bytes() };
+        let (lo, hi): ([u8; 4], [u8; 4]) = (b[0..4].try_into().unwrap(), b[4..8].try_into().unwrap());
+        if big { [i32::from_be_bytes(lo), i32::from_be_bytes(hi)] } else { [i32::from_le_bytes(lo), i32::from_le_bytes(hi)] }
+    };
+
+    let per_record = RECORD / 8;
+    let size = (nd + (ni + 1) / 2) as usize;
+    let mut summaries = Vec::new();
+    let mut next = int_at(76, big);
+    let mut visited = 0;
+
+    while next > 0 {
+        let base = (next as usize - 1) * per_record;
+        if base + per_record > words.len() || visited > words.len() / per_record {
+            return Err(bad("corrupt summary records"));
+        }
+        visited += 1;
+
+        let n = words[base + 2] as usize;
+        if 3 + n * size > per_record {
+            return Err(bad("corrupt summary record"));
+        }
+
+        for k in 0..n {
+            let s = &words[base + 3 + k * size..base + 3 + (k + 1) * size];
+            let (a, b, c) = (ints(s[2]), ints(s[3]), ints(s[4]));
+            let (begin, end) = (addr_index(c[0]), c[1].max(0) as usize);
+
+            if begin >= end || end > words.len() {
+                return Err(bad("segment address out of range"));
+            }
+
+            summaries.push(Summary { dc: [s[0], s[1]], ic: [a[0], a[1], b[0], b[1], c[0], c[1]], begin, end });
+        }
+
+        next = words[base] as i32;
+    }
+
+    Ok((words, summaries))
+}
+
+/// Converts a 1-based DAF word address to a 0-based index.
+fn addr_index(address: i32) -> usize {
+    (address.max(1) - 1) as usize
+}
@@ -0,0 +1,430 @@
+//! Multi-threaded ray intersections with DSK plate models.
+//!
+//! `dskxv_c` intersects arrays of rays with the loaded DSK surfaces, but it runs on a single
+//! thread, under the global state of CSPICE, and it searches the segments' spatial indexes one ray
+//! at a time. A [`ShapeModel`] instead reads the plates of the type 2 (triangular plate) DSK
+//! segments of a body once, into a read-only bounding volume hierarchy (BVH) in memory, which can
+//! then be shared by any number of threads to trace batches of rays, without calling CSPICE.
+//!
+//! Like `dskxv_c`, the intersection is the one nearest to the ray's vertex, and plates are
+//! expanded by a small fraction (`SPICE_DSK_XFRACT`, 1e-10 of their size) so that rays passing
+//! exactly through a shared edge or vertex do not leak between the plates. The intersection
+//! points agree with `dskxv_c` to within that tolerance (and rounding).
+//!
+//! ```no_run
+//! use libcspice_sys::dsk::ShapeModel;
+//!
+//! // Body-fixed plate model of Phobos (NAIF ID 401).
+//! let phobos = ShapeModel::load("phobos_3_3.bds", 401).unwrap();
+//!
+//! let vertices = vec![[100.0, 0.0, 0.0]; 1000];
+//! let directions = vec![[-1.0, 0.0, 0.0]; 1000];
+//! let mut points = vec![[0.0; 3]; 1000];
+//! let mut found = vec![false; 1000];
+//!
+//! phobos.par_intersect(&vertices, &directions, &mut points, &mut found, 0);
+//! ```
+
+use std::ffi::CString;
+use std::fmt;
+use std::path::Path;
+use std::thread;
+
+use crate::{
+    dascls_c, dasopr_c, dlabfs_c, dlafns_c, dskgd_c, dskp02_c, dskv02_c, dskz02_c, failed_c, reset_c,
+    SpiceBoolean, SpiceDLADescr, SpiceDSKDescr, SpiceDouble, SpiceInt, SPICEFALSE,
+};
+
+/// Plate expansion fraction, the same as `SPICE_DSK_XFRACT` used by `dskxv_c`.
+const XFRACT: f64 = 1e-10;
+
+/// DSK data type of triangular plate models.
+const PLATE_MODEL: SpiceInt = 2;
+
+/// Number of vertices or plates read from a segment per call.
+const ROOM: usize = 65536;
+
+/// Maximum number of plates in a leaf of the hierarchy.
+const LEAF_SIZE: usize = 4;
+
+/// Minimum number of rays per thread in parallel batches.
+const MIN_CHUNK: usize = 1024;
+
+/// Errors from loading DSK shape models.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum DskError {
+    /// The file has no type 2 (plate model) segments for the body.
+    NoPlates(String),
+    /// The plate segments of the body are given in different reference frames.
+    MixedFrames(String),
+    /// CSPICE signaled an error, e.g. while opening or reading the file.
+    Spice,
+}
+
+impl fmt::Display for DskError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            DskError::NoPlates(path) => write!(f, "no plate model segments for body in {}", path),
+            DskError::MixedFrames(path) => write!(f, "plate segments in different frames in {}", path),
+            DskError::Spice => write!(f, "CSPICE error while reading DSK file"),
+        }
+    }
+}
+
+impl std::error::Error for DskError {}
+
+/// Returns an error if CSPICE signaled one (resetting the error status).
+fn check_spice() -> Result<(), DskError> {
+    if unsafe { failed_c() } != SPICEFALSE as SpiceBoolean {
+        unsafe { reset_c() };
+        return Err(DskError::Spice);
+    }
+    Ok(())
+}
+
+/// A node of the bounding volume hierarchy. Internal nodes (`count == 0`) are followed by their
+/// first child, and `index` is the node index of their second child. Leaf nodes reference
+/// `count` plates from position `index` of the plate order.
+#[derive(Debug, Clone, Copy)]
+struct Node {
+    min: [f64; 3],
+    max: [f64; 3],
+    index: u32,
+    count: u32,
+}
+
+/// A triangular plate model, with a bounding volume hierarchy for fast ray intersections.
+#[derive(Debug, Clone)]
+pub struct ShapeModel {
+    frame_id: i32,
+    vertices: Vec<[f64; 3]>,
+    plates: Vec<[u32; 3]>,
+    order: Vec<u32>,
+    nodes: Vec<Node>,
+}
+
+fn sub(a: &[f64; 3], b: &[f64; 3]) -> [f64; 3] {
+    [a[0] - b[0], a[1] - b[1], a[2] - b[2]]
+}
+
+fn dot(a: &[f64; 3], b: &[f64; 3]) -> f64 {
+    a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+}
+
+fn cross(a: &[f64; 3], b: &[f64; 3]) -> [f64; 3] {
+    [a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]]
+}
+
+/// Reads the vertices and plates (0-based) of a type 2 DSK segment.
+fn read_segment(handle: SpiceInt, dla: &SpiceDLADescr, vertices: &mut Vec<[f64; 3]>, plates: &mut Vec<[u32; 3]>)
+                -> Result<(), DskError> {
+    let (mut nv, mut np): (SpiceInt, SpiceInt) = (0, 0);
+    unsafe { dskz02_c(handle, dla, &mut nv, &mut np) };
+    check_spice()?;
+
+    let base = vertices.len() as u32;
+    let mut buf = vec![[0.0 as SpiceDouble; 3]; ROOM];
+
+    while (vertices.len() - base as usize) < nv as usize {
+        let mut n: SpiceInt = 0;
+        let start = (vertices.len() - base as usize + 1) as SpiceInt;
+        unsafe { dskv02_c(handle, dla, start, ROOM as SpiceInt, &mut n, buf.as_mut_ptr()) };
+        check_spice()?;
+        if n <= 0 {
+            return Err(DskError::Spice);
+        }
+        vertices.extend_from_slice(&buf[..n as usize]);
+    }
+
+    let first = plates.len();
+    let mut buf = vec![[0 as SpiceInt; 3]; ROOM];
+
+    while plates.len() - first < np as usize {
+        let mut n: SpiceInt = 0;
+        let start = (plates.len() - first + 1) as SpiceInt;
+        unsafe { dskp02_c(handle, dla, start, ROOM as SpiceInt, &mut n, buf.as_mut_ptr()) };
+        check_spice()?;
+        if n <= 0 {
+            return Err(DskError::Spice);
+        }
+        // CSPICE vertex indices are 1-based.
+        plates.extend(buf[..n as usize].iter().map(|p| p.map(|v| base + v as u32 - 1)));
+    }
+
+    Ok(())
+}
+
+impl ShapeModel {
+    /// Loads the plates of all type 2 DSK segments for the body with NAIF ID `body` from a DSK
+    /// file. The file is opened and closed by the call, independently of the kernels loaded with
+    /// `furnsh_c`.
+    pub fn load<P: AsRef<Path>>(path: P, body: i32) -> Result<ShapeModel, DskError> {
+        let name = path.as_ref().to_string_lossy().into_owned();
+        let cpath = CString::new(name.as_str()).map_err(|_| DskError::NoPlates(name.clone()))?;
+        let mut handle: SpiceInt = 0;
+
+        unsafe { dasopr_c(cpath.as_ptr(), &mut handle) };
+        check_spice()?;
+
+        let result = Self::read(handle, body, &name);
+
+        unsafe { dascls_c(handle) };
+        let model = result?;
+        check_spice()?;
+
+        Ok(model)
+    }
+
+    fn read(handle: SpiceInt, body: i32, name: &str) -> Result<ShapeModel, DskError> {
+        let mut vertices = Vec::new();
+        let mut plates = Vec::new();
+        let mut frame_id = None;
+
+        let mut dla: SpiceDLADescr = unsafe { std::mem::zeroed() };
+        let mut found: SpiceBoolean = SPICEFALSE as SpiceBoolean;
+
+        unsafe { dlabfs_c(handle, &mut dla, &mut found) };
+        check_spice()?;
+
+        while found != SPICEFALSE as SpiceBoolean {
+            let mut dsk: SpiceDSKDescr = unsafe { std::mem::zeroed() };
+            unsafe { dskgd_c(handle, &dla, &mut dsk) };
+            check_spice()?;
+
+            if dsk.center == body as SpiceInt && dsk.dtype == PLATE_MODEL {
+                if *frame_id.get_or_insert(dsk.frmcde) != dsk.frmcde {
+                    return Err(DskError::MixedFrames(name.into()));
+                }
+                read_segment(handle, &dla, &mut vertices, &mut plates)?;
+            }
+
+            let current = dla;
+            unsafe { dlafns_c(handle, &current, &mut dla, &mut found) };
+            check_spice()?;
+        }
+
+        match frame_id {
+            Some(id) if !plates.is_empty() => Ok(ShapeModel::from_plates(id as i32, vertices, plates)),
+            _ => Err(DskError::NoPlates(name.into())),
+        }
+    }
+
+    /// Creates a shape model from vertices and plates, i.e. triplets of 0-based vertex indices,
+    /// given in the reference frame with CSPICE frame ID `frame_id`.
+    pub fn from_plates(frame_id: i32, vertices: Vec<[f64; 3]>, plates: Vec<[u32; 3]>) -> ShapeModel {
+        let mut model = ShapeModel {
+            frame_id,
+            order: (0..plates.len() as u32).collect(),
+            vertices,
+            plates,
+            nodes: Vec::new(),
+        };
+
+        let centroids: Vec<[f64; 3]> = model.plates.iter().map(|p| {
+            let [a, b, c] = p.map(|v| model.vertices[v as usize]);
+            [(a[0] + b[0] + c[0]) / 3.0, (a[1] + b[1] + c[1]) / 3.0, (a[2] + b[2] + c[2]) / 3.0]
+        }).collect();
+
+        if !model.plates.is_empty() {
+            model.nodes.reserve(2 * model.plates.len() / LEAF_SIZE + 1);
+            model.build(0, model.plates.len(), &centroids);
+        }
+
+        model
+    }
+
+    /// Builds the (sub)tree for the plates `order[from..to]`, returning its root node index.
+    fn build(&mut self, from: usize, to: usize, centroids: &[[f64; 3]]) -> usize {
+        let mut min = [f64::INFINITY; 3];
+        let mut max = [f64::NEG_INFINITY; 3];
+
+        for &p in &self.order[from..to] {
+            for &v in &self.plates[p as usize] {
+                let x = &self.vertices[v as usize];
+                for k in 0..3 {
+                    min[k] = min[k].min(x[k]);
+                    max[k] = max[k].max(x[k]);
+                }
+            }
+        }
+
+        // Pad the boxes by the plate expansion, and by rounding.
+        let pad = 2.0 * XFRACT * (0..3).map(|k| max[k] - min[k]).fold(0.0, f64::max)
+                + 4.0 * f64::EPSILON * (0..3).map(|k| min[k].abs().max(max[k].abs())).fold(0.0, f64::max);
+        for k in 0..3 {
+            min[k] -= pad;
+            max[k] += pad;
+        }
+
+        let node = self.nodes.len();
+        self.nodes.push(Node { min, max, index: from as u32, count: (to - from) as u32 });
+
+        if to - from <= LEAF_SIZE {
+            return node;
+        }
+
+        // Split at the median centroid along the longest axis of the box.
+        let axis = (0..3).max_by(|&a, &b| (max[a] - min[a]).total_cmp(&(max[b] - min[b]))).unwrap();
+        let mid = (from + to) / 2;
+        self.order[from..to].select_nth_unstable_by(mid - from, |&a, &b| {
+            centroids[a as usize][axis].total_cmp(&centroids[b as usize][axis])
+        });
+
+        self.build(from, mid, centroids);
+        let second = self.build(mid, to, centroids);
+        self.nodes[node].index = second as u32;
+        self.nodes[node].count = 0;
+
+        node
+    }
+
+    /// The CSPICE ID of the reference frame of the model (and of the rays).
+    pub fn frame_id(&self) -> i32 {
+        self.frame_id
+    }
+
+    /// The number of plates in the model.
+    pub fn plate_count(&self) -> usize {
+        self.plates.len()
+    }
+
+    /// Returns the distance along the ray (in units of `dir`) to the expanded plate, if the ray
+    /// intersects it before `t_max`.
+    fn hit_plate(&self, p: u32, vertex: &[f64; 3], dir: &[f64; 3], t_max: f64) -> Option<f64> {
+        let [a, b, c] = self.plates[p as usize].map(|v| &self.vertices[v as usize]);
+        let e1 = sub(b, a);
+        let e2 = sub(c, a);
+        let h = cross(dir, &e2);
+        let det = dot(&e1, &h);
+
+        if det == 0.0 {
+            return None;
+        }
+
+        // Moller-Trumbore, with barycentric coordinates allowed to exceed the plate by XFRACT.
+        let inv = 1.0 / det;
+        let s = sub(vertex, a);
+        let u = dot(&s, &h) * inv;
+        if u < -XFRACT || u > 1.0 + XFRACT {
+            return None;
+        }
+
+        let q = cross(&s, &e1);
+        let v = dot(dir, &q) * inv;
+        if v < -XFRACT || u + v > 1.0 + XFRACT {
+            return None;
+        }
+
+        let t = dot(&e2, &q) * inv;
+        (t >= 0.0 && t < t_max).then_some(t)
+    }
+
+    /// Returns the distance at which the ray enters a node's box, if it does before `t_max`.
+    fn hit_box(node: &Node, vertex: &[f64; 3], inv_dir: &[f64; 3], t_max: f64) -> Option<f64> {
+        let (mut t0, mut t1) = (0.0f64, t_max);
+        for k in 0..3 {
+            let a = (node.min[k] - vertex[k]) * inv_dir[k];
+            let b = (node.max[k] - vertex[k]) * inv_dir[k];
+            // min / max ignore the NaN from 0 * inf, for rays along a box face.
+            t0 = t0.max(a.min(b));
+            t1 = t1.min(a.max(b));
+        }
+        (t0 <= t1).then_some(t0)
+    }
+
+    /// Returns the intersection of a ray with the surface nearest to the ray's vertex, if any.
+    pub fn intersect(&self, vertex: &[f64; 3], dir: &[f64; 3]) -> Option<[f64; 3]> {
+        if self.nodes.is_empty() {
+            return None;
+        }
+
+        let inv_dir = dir.map(|d| 1.0 / d);
+        let mut t_hit = f64::INFINITY;
+
+        // Nodes to visit, with the distances at which the ray enters them.
+        let mut stack = [(0u32, 0.0f64); 64];
+        let mut depth = 0;
+
+        if let Some(t) = Self::hit_box(&self.nodes[0], vertex, &inv_dir, t_hit) {
+            stack[0] = (0, t);
+            depth = 1;
+        }
+
+        while depth > 0 {
+            depth -= 1;
+            let (i, t_enter) = stack[depth];
+
+            if t_enter >= t_hit {
+                continue;
+            }
+
+            let node = &self.nodes[i as usize];
+
+            if node.count > 0 {
+                let from = node.index as usize;
+                for &p in &self.order[from..from + node.count as usize] {
+                    if let Some(t) = self.hit_plate(p, vertex, dir, t_hit) {
+                        t_hit = t;
+                    }
+                }
+                continue;
+            }
+
+            // Visit the nearer child first.
+            let mut near = (i + 1, Self::hit_box(&self.nodes[i as usize + 1], vertex, &inv_dir, t_hit));
+            let mut far = (node.index, Self::hit_box(&self.nodes[node.index as usize], vertex, &inv_dir, t_hit));
+
+            if far.1.unwrap_or(f64::INFINITY) < near.1.unwrap_or(f64::INFINITY) {
+                std::mem::swap(&mut near, &mut far);
+            }
+
+            for (child, t) in [far, near] {
+                if let Some(t) = t {
+                    stack[depth] = (child, t);
+                    depth += 1;
+                }
+            }
+        }
+
+        t_hit.is_finite().then(|| [vertex[0] + t_hit * dir[0], vertex[1] + t_hit * dir[1], vertex[2] + t_hit * dir[2]])
+    }
+
+    /// Intersects arrays of rays with the surface, like `dskxv_c`. For each ray, `xpt` receives
+    /// the intersection point and `found` whether there was one.
+    ///
+    /// # Panics
+    ///
+    /// If the slices differ in length.
+    pub fn intersect_batch(&self, vertices: &[[f64; 3]], dirs: &[[f64; 3]], xpt: &mut [[f64; 3]], found: &mut [bool]) {
+        assert!(dirs.len() == vertices.len() && xpt.len() == vertices.len() && found.len() == vertices.len(),
+                "ray arrays differ in length");
+
+        for i in 0..vertices.len() {
+            match self.intersect(&vertices[i], &dirs[i]) {
+                Some(p) => {
+                    xpt[i] = p;
+                    found[i] = true;
+                }
+                None => found[i] = false,
+            }
+        }
+    }
+
+    /// Same as [`ShapeModel::intersect_batch`], but traces the rays on `threads` threads (or
+    /// on all available cores, if 0).
+    pub fn par_intersect(&self, vertices: &[[f64; 3]], dirs: &[[f64; 3]], xpt: &mut [[f64; 3]], found: &mut [bool],
+                         threads: usize) {
+        assert!(dirs.len() == vertices.len() && xpt.len() == vertices.len() && found.len() == vertices.len(),
+                "ray arrays differ in length");
+
+        let threads = if threads > 0 { threads } else { thread::available_parallelism().map_or(1, |n| n.get()) };
+        let chunk = vertices.len().div_ceil(threads).max(MIN_CHUNK);
+
+        thread::scope(|s| {
+            for (((v, d), x), f) in vertices.chunks(chunk).zip(dirs.chunks(chunk)).zip(xpt.chunks_mut(chunk))
+                    .zip(found.chunks_mut(chunk)) {
+                s.spawn(move || self.intersect_batch(v, d, x, f));
+            }
+        });
+    }
+}
@@ -0,0 +1,376 @@
+//! Cached frame rotations, for high-rate `pxform_c` / `sxform_c` queries.
+//!
+//! Each `pxform_c` or `sxform_c` call resolves the frame names, and chains the rotation through
+//! the frame subsystem, under the global state of CSPICE. Pointing code that queries the same
+//! pair of frames at closely spaced times pays that cost (and the serialization) on every call.
+//!
+//! A [`RotationCache`] resolves the frames once, and fits Chebyshev series to the elements of
+//! the rotation matrix over a time span, split adaptively into segments, until the fit agrees
+//! with CSPICE to within a given tolerance. Queries evaluate the series in pure Rust, without
+//! calling CSPICE, so the cache can be shared by any number of threads. A [`FrameCache`] holds
+//! the rotations for several frame pairs, looked up by frame ID.
+//!
+//! The tolerance is verified at check points midway between the nodes of each segment (and at
+//! the ends), where the error of a converged Chebyshev fit peaks. It is a practical, rather than
+//! a strict, bound, and it assumes that the rotation is smooth within the segments. Frames
+//! defined by CK segments with discontinuities (e.g. between separately interpolated pointing
+//! intervals) should be cached on spans without such gaps.
+//!
+//! ```no_run
+//! use libcspice_sys::frames::RotationCache;
+//!
+//! // J2000 to ITRF93, over a day, to 1 nrad (~0.2 mas).
+//! let cache = RotationCache::new("J2000", "ITRF93", [0.0, 86400.0], 1e-9).unwrap();
+//! let r = cache.rotation(3600.0).unwrap();
+//! ```
+
+use std::ffi::CString;
+use std::fmt;
+
+use crate::{
+    failed_c, namfrm_c, pxform_c, reset_c, sxform_c, SpiceBoolean, SpiceDouble, SpiceInt, SPICEFALSE,
+};
+
+/// Number of Chebyshev coefficients per matrix element and segment.
+const NCOEFFS: usize = 12;
+
+/// [s] Shortest segment, below which the fit is not refined further.
+const MIN_SPAN: f64 = 1e-3;
+
+/// Errors from building rotation caches.
+#[derive(Debug, Clone, PartialEq)]
+pub enum FrameError {
+    /// The frame name is not known to CSPICE.
+    UnknownFrame(String),
+    /// The time span is empty or invalid, or the tolerance is not positive.
+    Span,
+    /// The fit could not reach the tolerance near the given time (ET seconds).
+    Tolerance(f64),
+    /// CSPICE signaled an error, e.g. for lack of data to relate the frames.
+    Spice,
+}
+
+impl fmt::Display for FrameError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            FrameError::UnknownFrame(name) => write!(f, "unknown frame: {}", name),
+            FrameError::Span => write!(f, "invalid time span or tolerance for rotation cache"),
+            FrameError::Tolerance(et) => write!(f, "rotation fit did not converge near ET {}", et),
+            FrameError::Spice => write!(f, "CSPICE error while fitting frame rotation"),
+        }
+    }
+}
+
+impl std::error::Error for FrameError {}
+
+/// Returns an error if CSPICE signaled one (resetting the error status).
+fn check_spice() -> Result<(), FrameError> {
+    if unsafe { failed_c() } != SPICEFALSE as SpiceBoolean {
+        unsafe { reset_c() };
+        return Err(FrameError::Spice);
+    }
+    Ok(())
+}
+
+/// Returns the CSPICE frame ID for a frame name.
+pub fn frame_id(name: &str) -> Result<i32, FrameError> {
+    let cname = CString::new(name).map_err(|_| FrameError::UnknownFrame(name.into()))?;
+    let mut id: SpiceInt = 0;
+
+    unsafe { namfrm_c(cname.as_ptr(), &mut id) };
+    check_spice()?;
+
+    if id == 0 {
+        return Err(FrameError::UnknownFrame(name.into()));
+    }
+
+    Ok(id as i32)
+}
+
+/// Chebyshev coefficients of the 9 rotation matrix elements (and of their time derivatives, when
+/// rates are cached) over `[start, end]`.
+#[derive(Debug, Clone)]
+struct Segment {
+    start: f64,
+    end: f64,
+    coeffs: [[f64; NCOEFFS]; 9],
+    rates: Option<[[f64; NCOEFFS]; 9]>,
+}
+
+/// Returns the Chebyshev polynomials T<sub>0</sub>(x) ... T<sub>n-1</sub>(x) at `x` in `[-1, 1]`.
+fn basis(x: f64) -> [f64; NCOEFFS] {
+    let mut t = [1.0; NCOEFFS];
+    t[1] = x;
+    for k in 2..NCOEFFS {
+        t[k] = 2.0 * x * t[k - 1] - t[k - 2];
+    }
+    t
+}
+
+/// Evaluates the 9 Chebyshev series of a matrix for the given basis.
+fn matrix(coeffs: &[[f64; NCOEFFS]; 9], t: &[f64; NCOEFFS]) -> [[f64; 3]; 3] {
+    let mut m = [[0.0; 3]; 3];
+    for (k, c) in coeffs.iter().enumerate() {
+        m[k / 3][k % 3] = c.iter().zip(t).map(|(a, b)| a * b).sum();
+    }
+    m
+}
+
+/// Returns the coefficients of the derivative (w.r.t. `x`) of a Chebyshev series.
+fn derivative(c: &[f64; NCOEFFS]) -> [f64; NCOEFFS] {
+    let mut d = [0.0; NCOEFFS];
+    for k in (0..NCOEFFS - 1).rev() {
+        d[k] = 2.0 * (k + 1) as f64 * c[k + 1] + if k + 2 < NCOEFFS { d[k + 2] } else { 0.0 };
+    }
+    d[0] *= 0.5;
+    d
+}
+
+impl Segment {
+    fn x(&self, et: f64) -> f64 {
+        (2.0 * et - self.start - self.end) / (self.end - self.start)
+    }
+
+    fn rotation(&self, et: f64) -> [[f64; 3]; 3] {
+        matrix(&self.coeffs, &basis(self.x(et)))
+    }
+
+    fn rate(&self, et: f64) -> Option<[[f64; 3]; 3]> {
+        Some(matrix(self.rates.as_ref()?, &basis(self.x(et))))
+    }
+}
+
+/// Fitted rotations between two frames over a span of time (TDB / ET seconds past J2000).
+#[derive(Debug, Clone)]
+pub struct RotationCache {
+    from: CString,
+    to: CString,
+    from_id: i32,
+    to_id: i32,
+    tolerance: f64,
+    rate_tolerance: Option<f64>,
+    segments: Vec<Segment>,
+}
+
+impl RotationCache {
+    /// Fits the rotations from frame `from` to frame `to` (as returned by `pxform_c`) over the
+    /// `span` of ET seconds, to within `tolerance` (radians, or the equivalent error of the
+    /// matrix elements).
+    pub fn new(from: &str, to: &str, span: [f64; 2], tolerance: f64) -> Result<RotationCache, FrameError> {
+        Self::build(from, to, span, tolerance, None)
+    }
+
+    /// Same as [`RotationCache::new`], but also caches the rate of the rotation, for state
+    /// transformations (as returned by `sxform_c`). The derivative of the fit must agree with the
+    /// one from CSPICE to within `rate_tolerance` (per second).
+    pub fn with_rates(from: &str, to: &str, span: [f64; 2], tolerance: f64, rate_tolerance: f64)
+                      -> Result<RotationCache, FrameError> {
+        Self::build(from, to, span, tolerance, Some(rate_tolerance))
+    }
+
+    fn build(from: &str, to: &str, span: [f64; 2], tolerance: f64, rate_tolerance: Option<f64>)
+             -> Result<RotationCache, FrameError> {
+        if !(span[1] > span[0]) || !(tolerance > 0.0) || rate_tolerance.is_some_and(|t| !(t > 0.0)) {
+            return Err(FrameError::Span);
+        }
+
+        let mut cache = RotationCache {
+            from_id: frame_id(from)?,
+            to_id: frame_id(to)?,
+            from: CString::new(from).unwrap(),
+            to: CString::new(to).unwrap(),
+            tolerance,
+            rate_tolerance,
+            segments: Vec::new(),
+        };
+
+        // Fit depth-first, so the segments come out in time order.
+        let mut pending = vec![span];
+        while let Some([start, end]) = pending.pop() {
+            if let Some(segment) = cache.fit(start, end)? {
+                cache.segments.push(segment);
+            } else if end - start < 2.0 * MIN_SPAN {
+                return Err(FrameError::Tolerance(0.5 * (start + end)));
+            } else {
+                let mid = 0.5 * (start + end);
+                pending.push([mid, end]);
+                pending.push([start, mid]);
+            }
+        }
+
+        Ok(cache)
+    }
+
+    /// Samples the CSPICE rotation (and its rate, if needed) at `et`.
+    fn sample(&self, et: f64) -> Result<([[f64; 3]; 3], [[f64; 3]; 3]), FrameError> {
+        let mut r = [[0.0; 3]; 3];
+        let mut dr = [[0.0; 3]; 3];
+
+        if self.rate_tolerance.is_some() {
+            let mut xform = [[0.0 as SpiceDouble; 6]; 6];
+            unsafe { sxform_c(self.from.as_ptr(), self.to.as_ptr(), et, xform.as_mut_ptr()) };
+            for i in 0..3 {
+                for j in 0..3 {
+                    r[i][j] = xform[i][j];
+                    dr[i][j] = xform[3 + i][j];
+                }
+            }
+        } else {
+            unsafe { pxform_c(self.from.as_ptr(), self.to.as_ptr(), et, r.as_mut_ptr()) };
+        }
+        check_spice()?;
+
+        Ok((r, dr))
+    }
+
+    /// Fits a segment over `[start, end]`, returning `None` if it is not within tolerance.
+    fn fit(&self, start: f64, end: f64) -> Result<Option<Segment>, FrameError> {
+        let half = 0.5 * (end - start);
+        let mid = 0.5 * (start + end);
+        let node = |k: usize| (std::f64::consts::PI * (k as f64 + 0.5) / NCOEFFS as f64).cos();
+
+        let mut samples = Vec::with_capacity(NCOEFFS);
+        for k in 0..NCOEFFS {
+            samples.push(self.sample(mid + half * node(k))?.0);
+        }
+
+        let mut segment = Segment { start, end, coeffs: [[0.0; NCOEFFS]; 9], rates: None };
+
+        for (e, c) in segment.coeffs.iter_mut().enumerate() {
+            for (j, cj) in c.iter_mut().enumerate() {
+                let sum: f64 = samples.iter().enumerate().map(|(k, r)| {
+                    r[e / 3][e % 3] * (std::f64::consts::PI * j as f64 * (k as f64 + 0.5) / NCOEFFS as f64).cos()
+                }).sum();
+                *cj = sum * if j == 0 { 1.0 } else { 2.0 } / NCOEFFS as f64;
+            }
+        }
+
+        if self.rate_tolerance.is_some() {
+            let mut rates = [[0.0; NCOEFFS]; 9];
+            for (d, c) in rates.iter_mut().zip(segment.coeffs.iter()) {
+                *d = derivative(c);
+                d.iter_mut().for_each(|v| *v /= half);
+            }
+            segment.rates = Some(rates);
+        }
+
+        // Check points: the ends, and midway between the nodes.
+        let checks = std::iter::once(1.0)
+            .chain((0..NCOEFFS - 1).map(|k| (std::f64::consts::PI * (k + 1) as f64 / NCOEFFS as f64).cos()))
+            .chain(std::iter::once(-1.0));
+
+        for x in checks {
+            let et = mid + half * x;
+            let (r, dr) = self.sample(et)?;
+
+            if max_diff(&segment.rotation(et), &r) > self.tolerance {
+                return Ok(None);
+            }
+
+            if let (Some(tol), Some(fit)) = (self.rate_tolerance, segment.rate(et)) {
+                if max_diff(&fit, &dr) > tol {
+                    return Ok(None);
+                }
+            }
+        }
+
+        Ok(Some(segment))
+    }
+
+    /// Returns the segment that covers `et`, if any.
+    fn segment(&self, et: f64) -> Option<&Segment> {
+        let i = self.segments.partition_point(|s| s.end < et);
+        self.segments.get(i).filter(|s| s.start <= et)
+    }
+
+    /// The CSPICE ID of the frame rotated from.
+    pub fn from_id(&self) -> i32 {
+        self.from_id
+    }
+
+    /// The CSPICE ID of the frame rotated to.
+    pub fn to_id(&self) -> i32 {
+        self.to_id
+    }
+
+    /// The number of fitted segments.
+    pub fn len(&self) -> usize {
+        self.segments.len()
+    }
+
+    /// Whether the cache has no segments (never the case once built).
+    pub fn is_empty(&self) -> bool {
+        self.segments.is_empty()
+    }
+
+    /// Returns the `[start, end]` ET span covered by the cache.
+    pub fn span(&self) -> [f64; 2] {
+        [self.segments[0].start, self.segments[self.segments.len() - 1].end]
+    }
+
+    /// Returns the rotation matrix, like `pxform_c`, at `et`, or `None` if `et` is outside of
+    /// the cached span.
+    pub fn rotation(&self, et: f64) -> Option<[[f64; 3]; 3]> {
+        self.segment(et).map(|s| s.rotation(et))
+    }
+
+    /// Returns the state transformation matrix, like `sxform_c`, at `et`, or `None` if `et` is
+    /// outside of the cached span, or if the cache was built without rates.
+    pub fn state_rotation(&self, et: f64) -> Option<[[f64; 6]; 6]> {
+        let s = self.segment(et)?;
+        let t = basis(s.x(et));
+        let r = matrix(&s.coeffs, &t);
+        let dr = matrix(s.rates.as_ref()?, &t);
+        let mut xform = [[0.0; 6]; 6];
+
+        for i in 0..3 {
+            for j in 0..3 {
+                xform[i][j] = r[i][j];
+                xform[3 + i][3 + j] = r[i][j];
+                xform[3 + i][j] = dr[i][j];
+            }
+        }
+
+        Some(xform)
+    }
+}
+
+/// Returns the largest absolute difference between the elements of two matrices.
+fn max_diff(a: &[[f64; 3]; 3], b: &[[f64; 3]; 3]) -> f64 {
+    a.iter().flatten().zip(b.iter().flatten()).map(|(x, y)| (x - y).abs()).fold(0.0, f64::max)
+}
+
+/// Cached rotations for a set of frame pairs, looked up by CSPICE frame IDs.
+#[derive(Debug, Clone, Default)]
+pub struct FrameCache {
+    entries: Vec<RotationCache>,
+}
+
+impl FrameCache {
+    /// Creates an empty frame cache.
+    pub fn new() -> FrameCache {
+        FrameCache::default()
+    }
+
+    /// Adds (or replaces) the rotations for a frame pair.
+    pub fn insert(&mut self, cache: RotationCache) {
+        self.entries.retain(|e| e.from_id != cache.from_id || e.to_id != cache.to_id);
+        self.entries.push(cache);
+    }
+
+    /// Returns the cached rotations from frame ID `from` to frame ID `to`, if any.
+    pub fn get(&self, from: i32, to: i32) -> Option<&RotationCache> {
+        self.entries.iter().find(|e| e.from_id == from && e.to_id == to)
+    }
+
+    /// Returns the rotation matrix from frame ID `from` to frame ID `to` at `et`, if cached.
+    pub fn rotation(&self, from: i32, to: i32, et: f64) -> Option<[[f64; 3]; 3]> {
+        self.get(from, to)?.rotation(et)
+    }
+
+    /// Returns the state transformation matrix from frame ID `from` to frame ID `to` at `et`, if
+    /// cached with rates.
+    pub fn state_rotation(&self, from: i32, to: i32, et: f64) -> Option<[[f64; 6]; 6]> {
+        self.get(from, to)?.state_rotation(et)
+    }
+}
@@ -0,0 +1,390 @@
+//! Window-partitioned geometry-finder (GF) searches.
+//!
+//! CSPICE is not reentrant, so a GF search (`gfoclt_c`, `gfdist_c`, `gfsep_c`, `gfposc_c`,
+//! `gfrfov_c`, ...) always runs on a single thread, and searches in the same process can only be
+//! serialized. [`search_partitioned`] splits the confinement window of a search into parts of
+//! about equal measure, runs the search for each part in a separate worker process, forked from
+//! the calling process, so that it inherits the loaded kernels, and merges the result windows of
+//! the parts.
+//!
+//! Partitioning is valid only for searches whose result over a union of windows is the union of
+//! the results over each window, i.e. for binary state conditions, such as occultations,
+//! field-of-view visibility, or `"<"`, `">"`, `"="` relations. It is not valid for the `"ABSMIN"`,
+//! `"ABSMAX"`, `"LOCMIN"` and `"LOCMAX"` relations, whose result depends on the whole window.
+//!
+//! ```no_run
+//! use libcspice_sys::gf::{search_partitioned, Window};
+//! use libcspice_sys::gfoclt_c;
+//! use std::ffi::CString;
+//!
+//! let year = Window::from_intervals([[0.0, 365.25 * 86400.0]]);
+//! let s = |v: &str| CString::new(v).unwrap();
+//! let (any, moon, sun) = (s("ANY"), s("MOON"), s("SUN"));
+//! let (ellipsoid, moon_frame, sun_frame) = (s("ELLIPSOID"), s("IAU_MOON"), s("IAU_SUN"));
+//! let (lt, earth) = (s("LT"), s("EARTH"));
+//!
+//! let eclipses = search_partitioned(&year, 8, 1000, |cnfine, result| unsafe {
+//!     gfoclt_c(any.as_ptr(), moon.as_ptr(), ellipsoid.as_ptr(), moon_frame.as_ptr(),
+//!              sun.as_ptr(), ellipsoid.as_ptr(), sun_frame.as_ptr(), lt.as_ptr(),
+//!              earth.as_ptr(), 180.0, cnfine, result);
+//! }).unwrap();
+//! ```
+
+use std::ffi::{c_void, CStr};
+use std::fmt;
+use std::os::raw::c_char;
+
+use crate::{
+    _SpiceDataType_SPICE_DP, failed_c, furnsh_c, kdata_c, ktotal_c, reset_c, unload_c, wncard_c,
+    wnfetd_c, wninsd_c, SpiceBoolean, SpiceCell, SpiceDouble, SpiceInt, SPICEFALSE, SPICETRUE,
+    SPICE_CELL_CTRLSZ,
+};
+
+/// Kinds of binary kernels, which hold open files, and are re-opened by each worker process.
+const BINARY_KERNELS: &CStr = c"SPK CK PCK DSK EK";
+
+/// Errors from partitioned searches.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum GfError {
+    /// Could not start or communicate with a worker process.
+    Worker(String),
+    /// The search failed in a worker process (CSPICE signaled an error).
+    Search,
+}
+
+impl fmt::Display for GfError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            GfError::Worker(msg) => write!(f, "GF worker error: {}", msg),
+            GfError::Search => write!(f, "GF search failed"),
+        }
+    }
+}
+
+impl std::error::Error for GfError {}
+
+/// A time window: a sorted set of disjoint `[start, end]` intervals, e.g. in ET seconds.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct Window {
+    intervals: Vec<[f64; 2]>,
+}
+
+impl Window {
+    /// Creates a window from intervals in any order, merging those that overlap or touch.
+    pub fn from_intervals<I: IntoIterator<Item = [f64; 2]>>(intervals: I) -> Window {
+        let mut v: Vec<[f64; 2]> = intervals.into_iter().filter(|iv| iv[1] >= iv[0]).collect();
+        v.sort_by(|a, b| a[0].total_cmp(&b[0]));
+
+        let mut merged: Vec<[f64; 2]> = Vec::with_capacity(v.len());
+        for iv in v {
+            match merged.last_mut() {
+                Some(last) if iv[0] <= last[1] => last[1] = last[1].max(iv[1]),
+                _ => merged.push(iv),
+            }
+        }
+
+        Window { intervals: merged }
+    }
+
+    /// Merges several windows into one (their union).
+    pub fn union<'a, I: IntoIterator<Item = &'a Window>>(windows: I) -> Window {
+        Window::from_intervals(windows.into_iter().flat_map(|w| w.intervals.iter().copied()))
+    }
+
+    /// Returns a copy of the intervals of a CSPICE double precision window cell.
+    ///
+    /// # Safety
+    ///
+    /// The cell must be a valid, initialized CSPICE window of doubles.
+    pub unsafe fn from_cell(cell: &mut SpiceCell) -> Window {
+        let n = unsafe { wncard_c(cell) };
+        let mut intervals = Vec::with_capacity(n.max(0) as usize);
+
+        for i in 0..n {
+            let (mut left, mut right): (SpiceDouble, SpiceDouble) = (0.0, 0.0);
+            unsafe { wnfetd_c(cell, i, &mut left, &mut right) };
+            intervals.push([left, right]);
+        }
+
+        Window { intervals }
+    }
+
+    /// Calls `f` with a temporary CSPICE window cell, which holds the intervals of this window
+    /// and has room for at least `capacity` intervals in total.
+    pub fn with_cell<R>(&self, capacity: usize, f: impl FnOnce(&mut SpiceCell) -> R) -> R {
+        let mut cell = CellBuffer::new(capacity.max(self.intervals.len()));
+        for iv in &self.intervals {
+            unsafe { wninsd_c(iv[0], iv[1], cell.cell()) };
+        }
+        f(cell.cell())
+    }
+
+    /// The intervals of the window, in order.
+    pub fn intervals(&self) -> &[[f64; 2]] {
+        &self.intervals
+    }
+
+    /// The total length of the intervals of the window.
+    pub fn measure(&self) -> f64 {
+        self.intervals.iter().map(|iv| iv[1] - iv[0]).sum()
+    }
+
+    /// Splits the window into (at most) `n` consecutive, non-empty parts of about equal measure.
+    pub fn partition(&self, n: usize) -> Vec<Window> {
+        let total = self.measure();
+        if n <= 1 || total <= 0.0 {
+            return vec![self.clone()];
+        }
+
+        let step = total / n as f64;
+        let mut parts = Vec::with_capacity(n);
+        let mut part = Vec::new();
+        let mut room = step;
+
+        for &[mut a, b] in &self.intervals {
+            while b - a > room && parts.len() + 1 < n {
+                part.push([a, a + room]);
+                parts.push(Window { intervals: std::mem::take(&mut part) });
+                a += room;
+                room = step;
+            }
+            part.push([a, b]);
+            room -= b - a;
+        }
+
+        if !part.is_empty() {
+            parts.push(Window { intervals: part });
+        }
+
+        parts
+    }
+}
+
+/// Storage for a CSPICE double precision window cell.
+struct CellBuffer {
+    data: Vec<SpiceDouble>,
+    cell: SpiceCell,
+}
+
+impl CellBuffer {
+    fn new(capacity: usize) -> CellBuffer {
+        let size = 2 * capacity.max(1);
+        let mut data = vec![0.0; SPICE_CELL_CTRLSZ as usize + size];
+        let base = data.as_mut_ptr();
+
+        let cell = SpiceCell {
+            dtype: _SpiceDataType_SPICE_DP,
+            length: 0,
+            size: size as SpiceInt,
+            card: 0,
+            isSet: SPICETRUE as SpiceBoolean,
+            adjust: SPICEFALSE as SpiceBoolean,
+            init: SPICEFALSE as SpiceBoolean,
+            base: base as *mut c_void,
+            data: unsafe { base.add(SPICE_CELL_CTRLSZ as usize) } as *mut c_void,
+        };
+
+        CellBuffer { data, cell }
+    }
+
+    fn cell(&mut self) -> &mut SpiceCell {
+        debug_assert_eq!(self.cell.base, self.data.as_mut_ptr() as *mut c_void);
+        &mut self.cell
+    }
+}
+
+/// Runs a GF search over the confinement window `cnfine`, partitioned into `workers` parts that
+/// are searched in parallel, and returns the merged result window.
+///
+/// `search` is called with the confinement window and the (empty) result window cells of a part,
+/// and should run the GF search with these. `capacity` is the maximum number of result intervals
+/// per part. The kernels loaded when calling are available to the searches: text kernels are
+/// inherited as loaded, while binary kernels are re-opened by each worker, so they do not share
+/// file positions. Kernels should not be loaded or unloaded by `search`.
+///
+/// On Unix, each part is searched by a worker process, forked from the calling process. Elsewhere,
+/// the parts are searched in turn, in the calling process, and the result is the same.
+///
+/// The forked workers run `search` without `exec`, so the calling process should be
+/// single-threaded while searching: a lock held by another thread at the time of the fork (e.g.
+/// of `malloc`, or of a CSPICE wrapper) stays locked in the worker forever, and the worker then
+/// hangs. A worker that panics exits without unwinding into the caller, and the search returns
+/// [`GfError::Worker`].
+pub fn search_partitioned<F>(cnfine: &Window, workers: usize, capacity: usize, search: F) -> Result<Window, GfError>
+where
+    F: Fn(&mut SpiceCell, &mut SpiceCell),
+{
+    let parts = cnfine.partition(workers.max(1));
+
+    #[cfg(unix)]
+    let results = if parts.len() > 1 {
+        unix::search_forked(&parts, capacity, &search)?
+    } else {
+        vec![search_part(&parts[0], capacity, &search)?]
+    };
+
+    #[cfg(not(unix))]
+    let results = parts
+        .iter()
+        .map(|part| search_part(part, capacity, &search))
+        .collect::<Result<Vec<_>, _>>()?;
+
+    Ok(Window::union(&results))
+}
+
+/// Runs the search for one part of the confinement window, in the calling process.
+fn search_part<F>(part: &Window, capacity: usize, search: &F) -> Result<Window, GfError>
+where
+    F: Fn(&mut SpiceCell, &mut SpiceCell),
+{
+    let mut result = CellBuffer::new(capacity);
+
+    part.with_cell(0, |cnfine| search(cnfine, result.cell()));
+
+    if unsafe { failed_c() } != SPICEFALSE as SpiceBoolean {
+        unsafe { reset_c() };
+        return Err(GfError::Search);
+    }
+
+    Ok(unsafe { Window::from_cell(result.cell()) })
+}
+
+/// Returns the names of the loaded binary kernels, in load order.
+pub(crate) fn binary_kernels() -> Vec<Vec<c_char>> {
+    let mut count: SpiceInt = 0;
+    unsafe { ktotal_c(BINARY_KERNELS.as_ptr(), &mut count) };
+
+    (0..count)
+        .filter_map(|i| {
+            let mut file = vec![0 as c_char; 1024];
+            let mut filtyp = [0 as c_char; 32];
+            let mut source = vec![0 as c_char; 1024];
+            let mut handle: SpiceInt = 0;
+            let mut found: SpiceBoolean = SPICEFALSE as SpiceBoolean;
+
+            unsafe {
+                kdata_c(i, BINARY_KERNELS.as_ptr(), file.len() as SpiceInt, filtyp.len() as SpiceInt,
+                        source.len() as SpiceInt, file.as_mut_ptr(), filtyp.as_mut_ptr(), source.as_mut_ptr(),
+                        &mut handle, &mut found);
+            }
+
+            (found != SPICEFALSE as SpiceBoolean).then_some(file)
+        })
+        .collect()
+}
+
+/// Re-opens the loaded binary kernels, in their original load order (and priority).
+fn reopen_binary_kernels() {
+    let files = binary_kernels();
+
+    for file in &files {
+        unsafe { unload_c(file.as_ptr()) };
+    }
+    for file in &files {
+        unsafe { furnsh_c(file.as_ptr()) };
+    }
+}
+
+#[cfg(unix)]
+mod unix {
+    use super::{reopen_binary_kernels, search_part, GfError, SpiceCell, Window};
+    use std::io::{Read, Write};
+    use std::os::unix::net::UnixStream;
+    use std::panic::{self, AssertUnwindSafe};
+
+    unsafe extern "C" {
+        fn fork() -> i32;
+        fn waitpid(pid: i32, status: *mut i32, options: i32) -> i32;
+        fn _exit(status: i32) -> !;
+    }
+
+    /// Searches each part of the confinement window in a forked worker process, which returns
+    /// its result intervals through a socket.
+    pub(super) fn search_forked<F>(parts: &[Window], capacity: usize, search: &F) -> Result<Vec<Window>, GfError>
+    where
+        F: Fn(&mut SpiceCell, &mut SpiceCell),
+    {
+        let mut children = Vec::with_capacity(parts.len());
+        let mut error = None;
+
+        for part in parts {
+            let (ours, mut theirs) = match UnixStream::pair() {
+                Ok(pair) => pair,
+                Err(e) => {
+                    error = Some(GfError::Worker(e.to_string()));
+                    break;
+                }
+            };
+
+            let pid = unsafe { fork() };
+
+            if pid == 0 {
+                // Worker process: search, report, and exit without unwinding into the caller, even
+                // if the search panics.
+                let status = panic::catch_unwind(AssertUnwindSafe(|| {
+                    drop(ours);
+                    reopen_binary_kernels();
+
+                    match search_part(part, capacity, search) {
+                        Ok(result) => {
+                            let bytes: Vec<u8> = result.intervals().iter().flatten().flat_map(|x| x.to_le_bytes()).collect();
+                            if theirs.write_all(&bytes).is_ok() { 0 } else { 1 }
+                        }
+                        Err(_) => 2,
+                    }
+                }))
+                .unwrap_or(3);
+
+                unsafe { _exit(status) };
+            }
+
+            drop(theirs);
+
+            if pid < 0 {
+                error = Some(GfError::Worker(std::io::Error::last_os_error().to_string()));
+                break;
+            }
+
+            children.push((pid, ours));
+        }
+
+        let mut results = Vec::with_capacity(children.len());
+
+        for (pid, mut stream) in children {
+            let mut bytes = Vec::new();
+            let read = stream.read_to_end(&mut bytes);
+
+            let mut status = 0;
+            let waited = unsafe { waitpid(pid, &mut status, 0) };
+
+            if error.is_some() {
+                continue;
+            }
+
+            if let Err(e) = read {
+                error = Some(GfError::Worker(e.to_string()));
+            } else if waited != pid {
+                error = Some(GfError::Worker(std::io::Error::last_os_error().to_string()));
+            } else if status != 0 {
+                // Exit status 2 (in the upper byte of the wait status) signals a failed search, and
+                // 3 a panic in the search.
+                error = Some(match (status >> 8) & 0xff {
+                    2 => GfError::Search,
+                    3 => GfError::Worker("search panicked in worker".to_string()),
+                    _ => GfError::Worker(format!("worker exited with status {:#x}", status)),
+                });
+            } else {
+                let values: Vec<f64> = bytes
+                    .chunks_exact(8)
+                    .map(|b| f64::from_le_bytes(b.try_into().unwrap()))
+                    .collect();
+                results.push(Window::from_intervals(values.chunks_exact(2).map(|iv| [iv[0], iv[1]])));
+            }
+        }
+
+        match error {
+            Some(e) => Err(e),
+            None => Ok(results),
+        }
+    }
+}
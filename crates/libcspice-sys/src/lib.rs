@@ -2,3 +2,11 @@
 #![allow(non_camel_case_types)]
 #![allow(non_snake_case)]
 include!(concat!(env!("OUT_DIR"), "/bindings.rs"));
+
+pub mod ck;
+mod daf;
+pub mod dsk;
+pub mod frames;
+pub mod gf;
+pub mod snapshot;
+pub mod spk;
@@ -0,0 +1,362 @@
+//! Binary snapshots of the loaded CSPICE kernels, for fast startup.
+//!
+//! Loading text kernels (and meta-kernels) with `furnsh_c` means parsing them into the kernel
+//! pool, which dominates the startup time of services that load dozens of kernels. A
+//! [`KernelSnapshot`] captures the contents of the kernel pool, i.e. the variables of all loaded
+//! text kernels, together with the list of loaded binary kernels (SPK, CK, PCK, DSK, EK), into a
+//! compact binary form. Restoring it inserts the pool variables directly, without any parsing, and
+//! re-opens the binary kernels in their original load order.
+//!
+//! The internal state of the CSPICE DAF / DAS subsystems (file handles, segment buffers) cannot
+//! be exported from the toolkit. Re-opening a binary kernel, however, only reads its file record,
+//! while its segments are read on demand, so it is cheap compared to parsing text kernels.
+//!
+//! Note, that the pool variables restored from a snapshot are not associated with the text kernels
+//! they came from, so `ktotal_c` does not count, and `unload_c` cannot unload, those text kernels.
+//!
+//! ```no_run
+//! use libcspice_sys::snapshot::KernelSnapshot;
+//!
+//! // Once, e.g. at deployment, after loading the kernels with furnsh_c()...
+//! KernelSnapshot::capture().unwrap().save("kernels.snap").unwrap();
+//!
+//! // Then, at the startup of each worker:
+//! KernelSnapshot::load("kernels.snap").unwrap().restore().unwrap();
+//! ```
+
+use std::ffi::{CStr, CString};
+use std::fmt;
+use std::fs;
+use std::os::raw::{c_char, c_void};
+use std::path::Path;
+
+use crate::gf::binary_kernels;
+use crate::{
+    dtpool_c, failed_c, furnsh_c, gcpool_c, gdpool_c, gnpool_c, pcpool_c, pdpool_c, reset_c,
+    SpiceBoolean, SpiceChar, SpiceDouble, SpiceInt, SPICEFALSE,
+};
+
+/// Identifies snapshot files, and the version of their layout.
+const MAGIC: &[u8; 8] = b"CSPKSNP1";
+
+/// Maximum length of kernel pool variable names (plus termination).
+const NAME_LEN: usize = 33;
+
+/// Maximum length of kernel pool string values (plus termination).
+const VALUE_LEN: usize = 81;
+
+/// Number of names or values fetched from the kernel pool per call.
+const ROOM: usize = 256;
+
+/// Errors from capturing, reading, or restoring kernel snapshots.
+#[derive(Debug)]
+pub enum SnapshotError {
+    /// Reading or writing the snapshot file failed.
+    Io(std::io::Error),
+    /// The data is not a (valid) kernel snapshot.
+    Format(String),
+    /// A binary kernel of the snapshot is missing, or it differs from when it was captured.
+    Kernel(String),
+    /// CSPICE signaled an error.
+    Spice,
+}
+
+impl fmt::Display for SnapshotError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            SnapshotError::Io(e) => write!(f, "kernel snapshot I/O error: {}", e),
+            SnapshotError::Format(msg) => write!(f, "invalid kernel snapshot: {}", msg),
+            SnapshotError::Kernel(msg) => write!(f, "kernel snapshot mismatch: {}", msg),
+            SnapshotError::Spice => write!(f, "CSPICE error while processing kernel snapshot"),
+        }
+    }
+}
+
+impl std::error::Error for SnapshotError {}
+
+impl From<std::io::Error> for SnapshotError {
+    fn from(e: std::io::Error) -> Self {
+        SnapshotError::Io(e)
+    }
+}
+
+/// The values of a kernel pool variable.
+#[derive(Debug, Clone, PartialEq)]
+pub enum PoolValues {
+    Numeric(Vec<f64>),
+    Text(Vec<String>),
+}
+
+/// A snapshot of the kernel pool and of the loaded binary kernels.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct KernelSnapshot {
+    /// Loaded binary kernels, in load order, with their file sizes in bytes.
+    pub kernels: Vec<(String, u64)>,
+    /// The kernel pool variables, by name.
+    pub variables: Vec<(String, PoolValues)>,
+}
+
+/// Returns an error if CSPICE signaled one (resetting the error status).
+fn check_spice() -> Result<(), SnapshotError> {
+    if unsafe { failed_c() } != SPICEFALSE as SpiceBoolean {
+        unsafe { reset_c() };
+        return Err(SnapshotError::Spice);
+    }
+    Ok(())
+}
+
+/// Converts fixed-length, NUL terminated CSPICE strings to Rust strings.
+fn strings(buf: &[SpiceChar], len: usize, n: usize) -> Vec<String> {
+    buf.chunks(len)
+        .take(n)
+        .map(|s| unsafe { CStr::from_ptr(s.as_ptr()) }.to_string_lossy().into_owned())
+        .collect()
+}
+
+/// Returns the names of all variables in the kernel pool.
+fn pool_names() -> Result<Vec<String>, SnapshotError> {
+    let mut names = Vec::new();
+    let mut buf = vec![0 as c_char; ROOM * NAME_LEN];
+
+    loop {
+        let mut n: SpiceInt = 0;
+        let mut found: SpiceBoolean = SPICEFALSE as SpiceBoolean;
+
+        unsafe {
+            gnpool_c(c"*".as_ptr(), names.len() as SpiceInt, ROOM as SpiceInt, NAME_LEN as SpiceInt, &mut n,
+                     buf.as_mut_ptr() as *mut c_void, &mut found);
+        }
+        check_spice()?;
+
+        if found == SPICEFALSE as SpiceBoolean || n <= 0 {
+            break;
+        }
+
+        names.extend(strings(&buf, NAME_LEN, n as usize));
+
+        if (n as usize) < ROOM {
+            break;
+        }
+    }
+
+    Ok(names)
+}
+
+/// Returns the values of a kernel pool variable.
+fn pool_values(name: &str) -> Result<Option<PoolValues>, SnapshotError> {
+    let cname = CString::new(name).map_err(|e| SnapshotError::Format(e.to_string()))?;
+    let mut found: SpiceBoolean = SPICEFALSE as SpiceBoolean;
+    let mut size: SpiceInt = 0;
+    let mut kind: [SpiceChar; 1] = [0];
+
+    unsafe { dtpool_c(cname.as_ptr(), &mut found, &mut size, kind.as_mut_ptr()) };
+    check_spice()?;
+
+    if found == SPICEFALSE as SpiceBoolean {
+        return Ok(None);
+    }
+
+    let size = size.max(0) as usize;
+
+    if kind[0] as u8 == b'N' {
+        let mut values = vec![0.0; size.max(1)];
+        let mut n: SpiceInt = 0;
+
+        unsafe {
+            gdpool_c(cname.as_ptr(), 0, values.len() as SpiceInt, &mut n, values.as_mut_ptr(), &mut found);
+        }
+        check_spice()?;
+
+        values.truncate(n.max(0) as usize);
+        Ok(Some(PoolValues::Numeric(values)))
+    } else {
+        let mut buf = vec![0 as c_char; size.max(1) * VALUE_LEN];
+        let mut n: SpiceInt = 0;
+
+        unsafe {
+            gcpool_c(cname.as_ptr(), 0, size.max(1) as SpiceInt, VALUE_LEN as SpiceInt, &mut n,
+                     buf.as_mut_ptr() as *mut c_void, &mut found);
+        }
+        check_spice()?;
+
+        Ok(Some(PoolValues::Text(strings(&buf, VALUE_LEN, n.max(0) as usize))))
+    }
+}
+
+/// Sequential reader of snapshot data.
+struct Reader<'a> {
+    data: &'a [u8],
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> Result<&'a [u8], SnapshotError> {
+        if self.data.len() < n {
+            return Err(SnapshotError::Format("truncated data".into()));
+        }
+        let (head, tail) = self.data.split_at(n);
+        self.data = tail;
+        Ok(head)
+    }
+
+    fn u32(&mut self) -> Result<u32, SnapshotError> {
+        Ok(u32::from_le_bytes(self.take(4)?.try_into().unwrap()))
+    }
+
+    fn u64(&mut self) -> Result<u64, SnapshotError> {
+        Ok(u64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+
+    fn string(&mut self) -> Result<String, SnapshotError> {
+        let n = self.u32()? as usize;
+        String::from_utf8(self.take(n)?.to_vec()).map_err(|e| SnapshotError::Format(e.to_string()))
+    }
+}
+
+fn put_string(out: &mut Vec<u8>, s: &str) {
+    out.extend_from_slice(&(s.len() as u32).to_le_bytes());
+    out.extend_from_slice(s.as_bytes());
+}
+
+impl KernelSnapshot {
+    /// Captures the current kernel pool and list of loaded binary kernels.
+    pub fn capture() -> Result<KernelSnapshot, SnapshotError> {
+        let mut snapshot = KernelSnapshot::default();
+
+        for file in binary_kernels() {
+            let path = unsafe { CStr::from_ptr(file.as_ptr()) }.to_string_lossy().into_owned();
+            let size = fs::metadata(&path).map(|m| m.len()).unwrap_or(0);
+            snapshot.kernels.push((path, size));
+        }
+        check_spice()?;
+
+        for name in pool_names()? {
+            if let Some(values) = pool_values(&name)? {
+                snapshot.variables.push((name, values));
+            }
+        }
+
+        Ok(snapshot)
+    }
+
+    /// Restores the kernel pool variables, and loads the binary kernels, of the snapshot. The
+    /// variables are added to (or replace those in) the current kernel pool. Binary kernels whose
+    /// size differs from when the snapshot was captured are rejected.
+    pub fn restore(&self) -> Result<(), SnapshotError> {
+        for (path, size) in &self.kernels {
+            let actual = fs::metadata(path).map_err(|e| SnapshotError::Kernel(format!("{}: {}", path, e)))?.len();
+            if actual != *size {
+                return Err(SnapshotError::Kernel(format!("{}: size changed from {} to {} bytes", path, size, actual)));
+            }
+        }
+
+        for (name, values) in &self.variables {
+            let cname = CString::new(name.as_str()).map_err(|e| SnapshotError::Format(e.to_string()))?;
+
+            match values {
+                PoolValues::Numeric(v) => unsafe {
+                    pdpool_c(cname.as_ptr(), v.len() as SpiceInt, v.as_ptr() as *const SpiceDouble);
+                },
+                PoolValues::Text(v) => {
+                    let mut buf = vec![0 as c_char; v.len().max(1) * VALUE_LEN];
+                    for (i, s) in v.iter().enumerate() {
+                        for (j, &b) in s.as_bytes().iter().take(VALUE_LEN - 1).enumerate() {
+                            buf[i * VALUE_LEN + j] = b as c_char;
+                        }
+                    }
+                    unsafe {
+                        pcpool_c(cname.as_ptr(), v.len() as SpiceInt, VALUE_LEN as SpiceInt, buf.as_ptr() as *const c_void);
+                    }
+                }
+            }
+            check_spice()?;
+        }
+
+        for (path, _) in &self.kernels {
+            let cpath = CString::new(path.as_str()).map_err(|e| SnapshotError::Format(e.to_string()))?;
+            unsafe { furnsh_c(cpath.as_ptr()) };
+            check_spice()?;
+        }
+
+        Ok(())
+    }
+
+    /// Serializes the snapshot (little-endian, length-prefixed records).
+    pub fn to_bytes(&self) -> Vec<u8> {
+        let mut out = Vec::new();
+
+        out.extend_from_slice(MAGIC);
+        out.extend_from_slice(&(self.kernels.len() as u32).to_le_bytes());
+        out.extend_from_slice(&(self.variables.len() as u32).to_le_bytes());
+
+        for (path, size) in &self.kernels {
+            put_string(&mut out, path);
+            out.extend_from_slice(&size.to_le_bytes());
+        }
+
+        for (name, values) in &self.variables {
+            put_string(&mut out, name);
+            match values {
+                PoolValues::Numeric(v) => {
+                    out.push(b'N');
+                    out.extend_from_slice(&(v.len() as u32).to_le_bytes());
+                    v.iter().for_each(|x| out.extend_from_slice(&x.to_le_bytes()));
+                }
+                PoolValues::Text(v) => {
+                    out.push(b'C');
+                    out.extend_from_slice(&(v.len() as u32).to_le_bytes());
+                    v.iter().for_each(|s| put_string(&mut out, s));
+                }
+            }
+        }
+
+        out
+    }
+
+    /// Deserializes a snapshot from the output of [`KernelSnapshot::to_bytes`].
+    pub fn from_bytes(data: &[u8]) -> Result<KernelSnapshot, SnapshotError> {
+        let mut r = Reader { data };
+
+        if r.take(MAGIC.len())? != MAGIC {
+            return Err(SnapshotError::Format("not a kernel snapshot".into()));
+        }
+
+        let nk = r.u32()? as usize;
+        let nv = r.u32()? as usize;
+        let mut snapshot = KernelSnapshot::default();
+
+        for _ in 0..nk {
+            let path = r.string()?;
+            let size = r.u64()?;
+            snapshot.kernels.push((path, size));
+        }
+
+        for _ in 0..nv {
+            let name = r.string()?;
+            let kind = r.take(1)?[0];
+            let n = r.u32()? as usize;
+
+            let values = match kind {
+                b'N' => PoolValues::Numeric(
+                    r.take(8 * n)?.chunks_exact(8).map(|b| f64::from_le_bytes(b.try_into().unwrap())).collect(),
+                ),
+                b'C' => PoolValues::Text((0..n).map(|_| r.string()).collect::<Result<_, _>>()?),
+                _ => return Err(SnapshotError::Format(format!("invalid type of variable {}", name))),
+            };
+
+            snapshot.variables.push((name, values));
+        }
+
+        Ok(snapshot)
+    }
+
+    /// Writes the snapshot to a file.
+    pub fn save<P: AsRef<Path>>(&self, path: P) -> Result<(), SnapshotError> {
+        fs::write(path, self.to_bytes())?;
+        Ok(())
+    }
+
+    /// Reads a snapshot from a file.
+    pub fn load<P: AsRef<Path>>(path: P) -> Result<KernelSnapshot, SnapshotError> {
+        KernelSnapshot::from_bytes(&fs::read(path)?)
+    }
+}
@@ -0,0 +1,334 @@
+//! Indexed SPK segment lookup, for many loaded SPK kernels.
+//!
+//! For each state query, CSPICE's SPK subsystem searches its buffered segment lists, file by file
+//! and in order of priority, for a segment covering the body and time. With hundreds of loaded
+//! kernels, e.g. one per spacecraft and per reconstruction arc, the search dominates the query.
+//!
+//! An [`SpkIndex`] reads the segment summaries of a set of SPK files once, and resolves the
+//! coverage of each body into disjoint intervals, each assigned to the segment that CSPICE would
+//! use there (the last loaded file, and the last segment within a file, take priority). A query
+//! is then a binary search for the body's interval containing the time, followed by the
+//! evaluation of the Chebyshev record in pure Rust. The segment data of the files is read into
+//! memory once, when the index is built, so queries involve no I/O, and the index can be shared
+//! by any number of threads.
+//!
+//! Only the Chebyshev segment types (2 and 3), which hold planetary ephemerides and most
+//! reconstructed trajectories, are evaluated. Queries falling on segments of other types return
+//! [`SpkError::UnsupportedType`], so the caller may fall back to `spkgeo_c` for those.
+//!
+//! ```no_run
+//! use libcspice_sys::spk::SpkIndex;
+//!
+//! // Index the SPK kernels loaded via furnsh_c()...
+//! let index = SpkIndex::from_loaded().unwrap();
+//!
+//! // Moon (301) relative to the Earth (399), in J2000, at ET 0.
+//! let state = index.geometric(301, 399, 0.0).unwrap();
+//! ```
+
+use std::collections::HashMap;
+use std::ffi::CStr;
+use std::fmt;
+use std::fs;
+use std::path::Path;
+
+use crate::daf;
+
+/// NAIF kernel type of the kernels to index.
+const SPK_KERNELS: &CStr = c"SPK";
+
+/// NAIF ID of the Solar System Barycenter, at which center chains end.
+const SSB: i32 = 0;
+
+/// NAIF ID of the J2000 frame.
+const J2000: i32 = 1;
+
+/// Longest chain of centers followed from a body to the Solar System Barycenter.
+const MAX_CHAIN: usize = 32;
+
+/// Errors from building, or querying, an SPK index.
+#[derive(Debug)]
+pub enum SpkError {
+    /// Reading an SPK file failed.
+    Io(std::io::Error),
+    /// The file is not a (valid) SPK file.
+    Format(String),
+    /// No segment covers the body (NAIF ID) at the time (ET seconds).
+    NoData(i32, f64),
+    /// The covering segment is of an SPK type that is not evaluated by the index.
+    UnsupportedType(i32),
+    /// The covering segment is referred to a frame (NAIF ID) other than J2000, which would need
+    /// CSPICE's frame subsystem to chain with other segments.
+    UnsupportedFrame(i32),
+}
+
+impl fmt::Display for SpkError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            SpkError::Io(e) => write!(f, "SPK I/O error: {}", e),
+            SpkError::Format(msg) => write!(f, "invalid SPK file: {}", msg),
+            SpkError::NoData(body, et) => write!(f, "no SPK data for body {} at ET {}", body, et),
+            SpkError::UnsupportedType(t) => write!(f, "SPK segment type {} is not supported by the index", t),
+            SpkError::UnsupportedFrame(id) => write!(f, "SPK segment frame {} is not J2000", id),
+        }
+    }
+}
+
+impl std::error::Error for SpkError {}
+
+impl From<std::io::Error> for SpkError {
+    fn from(e: std::io::Error) -> Self {
+        SpkError::Io(e)
+    }
+}
+
+/// The state of a body from a single segment.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SegmentState {
+    /// [km, km/s] Position and velocity, relative to the center.
+    pub state: [f64; 6],
+    /// NAIF ID of the center of motion.
+    pub center: i32,
+    /// NAIF ID of the reference frame.
+    pub frame: i32,
+}
+
+/// A segment of an SPK file.
+#[derive(Debug, Clone)]
+struct Segment {
+    /// Index of the file, in the index.
+    file: usize,
+    center: i32,
+    frame: i32,
+    kind: i32,
+    /// Word address (0-based) of the first double of the segment data.
+    begin: usize,
+    /// Word address (0-based) after the last double of the segment data.
+    end: usize,
+}
+
+/// A part of the coverage of a body, and the segment that serves it.
+#[derive(Debug, Clone, Copy)]
+struct Coverage {
+    start: f64,
+    stop: f64,
+    segment: usize,
+}
+
+/// An index of the segments of a set of SPK files, for direct lookups of body states.
+#[derive(Debug, Default)]
+pub struct SpkIndex {
+    /// The contents of the files, as doubles in native byte order.
+    files: Vec<Vec<f64>>,
+    segments: Vec<Segment>,
+    /// Disjoint coverage intervals, in increasing time order, by body.
+    bodies: HashMap<i32, Vec<Coverage>>,
+}
+
+/// Parses the contents of a DAF/SPK file, returning its contents as doubles, and its segments,
+/// with the NAIF IDs of their targets, in file order.
+fn parse_spk(name: &str, bytes: &[u8], file: usize) -> Result<(Vec<f64>, Vec<(i32, f64, f64, Segment)>), SpkError> {
+    let (words, summaries) = daf::parse(name, bytes, b"DAF/SPK ").map_err(SpkError::Format)?;
+
+    let segments = summaries.into_iter()
+        .map(|s| {
+            let [target, center, frame, kind, _, _] = s.ic;
+            (target, s.dc[0], s.dc[1], Segment { file, center, frame, kind, begin: s.begin, end: s.end })
+        })
+        .collect();
+
+    Ok((words, segments))
+}
+
+/// Evaluates a Chebyshev series, and its derivative w.r.t. the normalized time, at `x` in [-1, 1].
+fn chebyshev(c: &[f64], x: f64) -> (f64, f64) {
+    let (mut b1, mut b2, mut d1, mut d2) = (0.0, 0.0, 0.0, 0.0);
+    for k in (1..c.len()).rev() {
+        let b0 = 2.0 * x * b1 - b2 + c[k];
+        let d0 = 2.0 * x * d1 - d2 + 2.0 * b1;
+        (b2, b1, d2, d1) = (b1, b0, d1, d0);
+    }
+    (x * b1 - b2 + c[0], x * d1 - d2 + b1)
+}
+
+impl SpkIndex {
+    /// Indexes the SPK kernels loaded in CSPICE (via `furnsh_c`), with the same priorities.
+    pub fn from_loaded() -> Result<SpkIndex, SpkError> {
+        SpkIndex::open(&daf::loaded(SPK_KERNELS))
+    }
+
+    /// Indexes SPK files, given in load order, i.e. later files take priority over earlier ones
+    /// where they overlap.
+    pub fn open<P: AsRef<Path>>(paths: &[P]) -> Result<SpkIndex, SpkError> {
+        let mut index = SpkIndex::default();
+        let mut summaries = Vec::new();
+
+        for (file, path) in paths.iter().enumerate() {
+            let bytes = fs::read(path)?;
+            let (words, s) = parse_spk(&path.as_ref().display().to_string(), &bytes, file)?;
+            index.files.push(words);
+            summaries.push(s);
+        }
+
+        // Assign coverage in order of priority: last file first, and last segment first within it.
+        for (target, start, stop, s) in summaries.into_iter().rev().flat_map(|s| s.into_iter().rev()) {
+            let segment = index.segments.len();
+            index.segments.push(s);
+            let cover = index.bodies.entry(target).or_default();
+            SpkIndex::add_coverage(cover, start, stop, segment);
+        }
+
+        Ok(index)
+    }
+
+    /// Adds the parts of [start, stop] not covered yet to the disjoint coverage of a body. The new
+    /// parts share their boundaries with the (higher priority) parts already present, to which
+    /// lookups resolve at the boundaries.
+    fn add_coverage(cover: &mut Vec<Coverage>, start: f64, stop: f64, segment: usize) {
+        let mut gaps = Vec::new();
+        let mut from = start;
+
+        for c in cover.iter() {
+            if c.stop < from {
+                continue;
+            }
+            if c.start > stop {
+                break;
+            }
+            if c.start > from {
+                gaps.push(Coverage { start: from, stop: c.start, segment });
+            }
+            from = from.max(c.stop);
+            if from >= stop {
+                break;
+            }
+        }
+        if from < stop {
+            gaps.push(Coverage { start: from, stop, segment });
+        }
+
+        cover.extend(gaps);
+        cover.sort_by(|a, b| a.start.total_cmp(&b.start));
+    }
+
+    /// The number of indexed segments.
+    pub fn len(&self) -> usize {
+        self.segments.len()
+    }
+
+    /// Whether there are no indexed segments.
+    pub fn is_empty(&self) -> bool {
+        self.segments.is_empty()
+    }
+
+    /// The NAIF IDs of the indexed bodies.
+    pub fn bodies(&self) -> Vec<i32> {
+        let mut ids: Vec<i32> = self.bodies.keys().copied().collect();
+        ids.sort_unstable();
+        ids
+    }
+
+    /// The segment that serves the body at a time.
+    fn find(&self, body: i32, et: f64) -> Option<&Segment> {
+        let cover = self.bodies.get(&body)?;
+        let k = cover.partition_point(|c| c.start <= et);
+
+        // The parts are disjoint, except for shared boundaries, where the part of the higher
+        // priority (i.e. lower index) segment serves.
+        cover[..k].iter().rev().take_while(|c| c.stop >= et)
+            .min_by_key(|c| c.segment)
+            .map(|c| &self.segments[c.segment])
+    }
+
+    /// [km, km/s] The state of a body at `et` (TDB seconds past J2000) from the segment serving it,
+    /// relative to the segment's center, and in the segment's frame.
+    pub fn state(&self, body: i32, et: f64) -> Result<SegmentState, SpkError> {
+        let seg = self.find(body, et).ok_or(SpkError::NoData(body, et))?;
+        let data = &self.files[seg.file][seg.begin..seg.end];
+        let n_comp = match seg.kind {
+            2 => 3,
+            3 => 6,
+            t => return Err(SpkError::UnsupportedType(t)),
+        };
+
+        // Directory at the end of the segment: INIT, INTLEN, RSIZE, N
+        let bad = || SpkError::Format(format!("corrupt type {} segment for body {}", seg.kind, body));
+        if data.len() < 4 {
+            return Err(bad());
+        }
+        let dir = &data[data.len() - 4..];
+        let (init, intlen, rsize, n) = (dir[0], dir[1], dir[2] as usize, dir[3] as usize);
+        let n_coef = rsize.saturating_sub(2) / n_comp;
+        if n == 0 || n_coef == 0 || n * rsize + 4 > data.len() {
+            return Err(bad());
+        }
+
+        let k = (((et - init) / intlen).floor().max(0.0) as usize).min(n - 1);
+        let rec = &data[k * rsize..(k + 1) * rsize];
+        let (mid, radius) = (rec[0], rec[1]);
+        let x = (et - mid) / radius;
+
+        let mut state = [0.0; 6];
+        for i in 0..3 {
+            let (p, dp) = chebyshev(&rec[2 + i * n_coef..2 + (i + 1) * n_coef], x);
+            state[i] = p;
+            state[3 + i] = if n_comp == 6 {
+                chebyshev(&rec[2 + (i + 3) * n_coef..2 + (i + 4) * n_coef], x).0
+            } else {
+                dp / radius
+            };
+        }
+
+        Ok(SegmentState { state, center: seg.center, frame: seg.frame })
+    }
+
+    /// The chain of centers from a body, down to the Solar System Barycenter, with the J2000 states
+    /// relative to the next center in the chain, and the length of the chain.
+    fn chain(&self, body: i32, et: f64) -> Result<([(i32, [f64; 6]); MAX_CHAIN], usize), SpkError> {
+        let mut chain = [(SSB, [0.0; 6]); MAX_CHAIN];
+        let mut n = 0;
+        let mut id = body;
+
+        while id != SSB {
+            if n >= MAX_CHAIN {
+                return Err(SpkError::Format(format!("circular chain of centers for body {}", body)));
+            }
+            let s = self.state(id, et)?;
+            if s.frame != J2000 {
+                return Err(SpkError::UnsupportedFrame(s.frame));
+            }
+            chain[n] = (id, s.state);
+            n += 1;
+            id = s.center;
+        }
+
+        Ok((chain, n))
+    }
+
+    /// [km, km/s] The geometric J2000 state of `target` relative to `center` at `et` (TDB seconds past
+    /// J2000), like `spkgeo_c`, for segments referred to J2000. The states are chained only up to the
+    /// nearest common center, so e.g. the Moon relative to the Earth is not degraded by the precision
+    /// of barycentric states.
+    pub fn geometric(&self, target: i32, center: i32, et: f64) -> Result<[f64; 6], SpkError> {
+        let (t, nt) = self.chain(target, et)?;
+        let (c, nc) = self.chain(center, et)?;
+        let (t, c) = (&t[..nt], &c[..nc]);
+
+        // The nearest common center is the first in the target's chain (including the target itself)
+        // that is also in the center's chain (including the center itself), or else the barycenter.
+        let common = t.iter().map(|e| e.0).find(|id| *id == center || c.iter().any(|e| e.0 == *id)).unwrap_or(SSB);
+
+        let sum = |chain: &[(i32, [f64; 6])]| {
+            let mut s = [0.0; 6];
+            for (_, v) in chain.iter().take_while(|e| e.0 != common) {
+                for i in 0..6 {
+                    s[i] += v[i];
+                }
+            }
+            s
+        };
+
+        let (pt, pc) = (sum(t), sum(c));
+        Ok(std::array::from_fn(|i| pt[i] - pc[i]))
+    }
+}
@@ -0,0 +1,331 @@
+use criterion::{criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion, Throughput};
+use std::ffi::CString;
+use std::hint::black_box;
+use std::os::raw::{c_char, c_double, c_int, c_short};
+use std::sync::OnceLock;
+use std::thread;
+use std::time::{Duration, Instant};
+use supernovas_sys as sn;
+
+// DE405 test kernel shared with libcspice-sys, readable both by CALCEPH and CSPICE
+const DE405: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../libcspice-sys/tests/data/de405.bsp");
+
+const JD0: f64 = 2460676.5;        // [day] 2025-01-01 (TDB), well inside DE405
+const CIO_RECORDS: usize = 4096;   // CIO locator records, 1.2 days apart
+const QUERIES_PER_THREAD: u64 = 10_000; // planet queries per thread in the lock scaling runs
+const THREAD_COUNTS: [usize; 4] = [1, 2, 4, 8];
+
+// eph_manager.c, which is not part of the generated bindings
+unsafe extern "C" {
+    fn ephem_open(ephem_name: *const c_char, jd_begin: *mut c_double, jd_end: *mut c_double,
+        de_number: *mut c_short) -> c_short;
+    fn ephem_close() -> c_short;
+    fn ephem_set_cache_size(n: c_int) -> c_int;
+    fn state(jed: *const c_double, target: c_int, target_pos: *mut c_double, target_vel: *mut c_double) -> c_short;
+}
+
+fn die(msg: &str) -> ! {
+    eprintln!("ERROR! {}", msg);
+    std::process::exit(1);
+}
+
+// Uses a shared CALCEPH instance with the DE405 kernel for planets and other bodies. The planet
+// provider is set explicitly, since novas_use_calceph() keeps one that is already set (e.g. CSPICE).
+// The instance is opened once, and reused by every setup.
+fn use_calceph_shared() {
+    static EPH: OnceLock<usize> = OnceLock::new();
+
+    let eph = *EPH.get_or_init(|| {
+        let path = CString::new(DE405).unwrap();
+        unsafe { sn::calceph_open(path.as_ptr()) as usize }
+    }) as *mut sn::t_calcephbin;
+
+    if eph.is_null() || unsafe { sn::novas_use_calceph(eph) } != 0 || unsafe { sn::novas_use_calceph_planets(eph) } != 0 {
+        die("could not open DE405 with CALCEPH");
+    }
+}
+
+// Uses CALCEPH with per-thread instances, if needed, for lock-free queries, for planets and other
+// bodies alike
+fn use_calceph_per_thread() {
+    let path = CString::new(DE405).unwrap();
+    let files = [path.as_ptr()];
+    if unsafe { sn::novas_use_calceph_files(files.as_ptr(), 1) } != 0
+        || unsafe { sn::novas_use_calceph_planet_files(files.as_ptr(), 1) } != 0 {
+        die("could not set up per-thread CALCEPH access");
+    }
+}
+
+// Uses CSPICE, which serializes all queries internally
+fn use_cspice() {
+    let path = CString::new(DE405).unwrap();
+    if unsafe { sn::cspice_add_kernel(path.as_ptr()) } != 0 || unsafe { sn::novas_use_cspice() } != 0 {
+        die("could not load DE405 into CSPICE");
+    }
+}
+
+fn make_time(jd_tt: f64) -> sn::novas_timespec {
+    let mut time: sn::novas_timespec = unsafe { std::mem::zeroed() };
+    if unsafe { sn::novas_set_time(sn::novas_timescale_NOVAS_TT, jd_tt, 37, 0.114, &mut time) } != 0 {
+        die("failed to set time");
+    }
+    time
+}
+
+fn make_observer() -> sn::observer {
+    let mut obs: sn::observer = unsafe { std::mem::zeroed() };
+    if unsafe { sn::make_observer_on_surface(50.7374, 7.0982, 60.0, 10.0, 1000.0, &mut obs) } != 0 {
+        die("failed to define observer");
+    }
+    obs
+}
+
+fn make_frame(accuracy: sn::novas_accuracy, jd_tt: f64) -> sn::novas_frame {
+    let obs = make_observer();
+    let time = make_time(jd_tt);
+    let mut frame: sn::novas_frame = unsafe { std::mem::zeroed() };
+    if unsafe { sn::novas_make_frame(accuracy, &obs, &time, 0.0, 0.0, &mut frame) } != 0 {
+        die("failed to make frame");
+    }
+    frame
+}
+
+fn bench_make_frame(c: &mut Criterion) {
+    use_calceph_shared();
+
+    let obs = make_observer();
+    let mut g = c.benchmark_group("novas_make_frame");
+
+    for (label, accuracy) in [("full", sn::novas_accuracy_NOVAS_FULL_ACCURACY),
+        ("reduced", sn::novas_accuracy_NOVAS_REDUCED_ACCURACY)] {
+        let mut k = 0u64;
+        g.bench_function(label, |b| {
+            b.iter(|| {
+                // A new epoch for each frame, so nothing is served from cache
+                k += 1;
+                let time = make_time(JD0 + k as f64 * 1e-3);
+                let mut frame: sn::novas_frame = unsafe { std::mem::zeroed() };
+                unsafe { sn::novas_make_frame(accuracy, &obs, &time, 0.0, 0.0, &mut frame) };
+                black_box(frame.gst)
+            })
+        });
+    }
+    g.finish();
+}
+
+fn bench_sky_pos(c: &mut Criterion) {
+    use_calceph_shared();
+
+    let frame = make_frame(sn::novas_accuracy_NOVAS_FULL_ACCURACY, JD0);
+
+    let name = CString::new("Antares").unwrap();
+    let catalog = CString::new("FK5").unwrap();
+    let mut star: sn::cat_entry = unsafe { std::mem::zeroed() };
+    let mut sources: Vec<(&str, sn::object)> = Vec::new();
+    unsafe {
+        let mut obj: sn::object = std::mem::zeroed();
+        sn::make_cat_entry(name.as_ptr(), catalog.as_ptr(), 1, 16.49, -26.43, -12.11, -23.30, 5.89, -3.4, &mut star);
+        sn::make_cat_object(&star, &mut obj);
+        sources.push(("star", obj));
+
+        sn::make_planet(sn::novas_planet_NOVAS_MARS, &mut obj);
+        sources.push(("planet", obj));
+
+        // The Moon, by its NAIF ID, as a generic ephemeris body
+        let moon = CString::new("Moon").unwrap();
+        sn::make_ephem_object(moon.as_ptr(), 301, &mut obj);
+        sources.push(("ephem", obj));
+    }
+
+    let mut g = c.benchmark_group("novas_sky_pos");
+    for (label, source) in sources.iter() {
+        g.bench_function(*label, |b| {
+            b.iter(|| {
+                let mut pos: sn::sky_pos = unsafe { std::mem::zeroed() };
+                let res = unsafe { sn::novas_sky_pos(source, &frame, sn::novas_reference_system_NOVAS_TOD, &mut pos) };
+                if res != 0 {
+                    die(&format!("novas_sky_pos() failed for {}: {}", label, res));
+                }
+                black_box(pos.ra)
+            })
+        });
+    }
+    g.finish();
+}
+
+fn bench_nutation(c: &mut Criterion) {
+    let mut g = c.benchmark_group("nutation");
+    let mut k = 0u64;
+
+    g.bench_function("iau2000a", |b| {
+        b.iter(|| {
+            let (mut dpsi, mut deps) = (0.0, 0.0);
+            k += 1;
+            unsafe { sn::iau2000a(JD0, k as f64 * 1e-3, &mut dpsi, &mut deps) };
+            black_box(dpsi + deps)
+        })
+    });
+
+    g.bench_function("nu2000k", |b| {
+        b.iter(|| {
+            let (mut dpsi, mut deps) = (0.0, 0.0);
+            k += 1;
+            unsafe { sn::nu2000k(JD0, k as f64 * 1e-3, &mut dpsi, &mut deps) };
+            black_box(dpsi + deps)
+        })
+    });
+    g.finish();
+}
+
+fn bench_cio_array(c: &mut Criterion) {
+    // CIO locator data calculated in memory, so no locator file is required
+    let start = JD0 - 0.5 * CIO_RECORDS as f64 * 1.2;
+    let mut recs = vec![sn::ra_of_cio { jd_tdb: 0.0, ra_cio: 0.0 }; CIO_RECORDS];
+    if unsafe { sn::novas_make_cio_locator(sn::novas_accuracy_NOVAS_FULL_ACCURACY, start, 1.2, CIO_RECORDS as _,
+        recs.as_mut_ptr()) } != 0 {
+        die("failed to calculate CIO locator data");
+    }
+
+    let install = || {
+        if unsafe { sn::novas_set_cio_locator_data(recs.as_ptr(), CIO_RECORDS as _) } != 0 {
+            die("failed to set CIO locator data");
+        }
+    };
+
+    let mut g = c.benchmark_group("cio_array");
+    let mut out = [sn::ra_of_cio { jd_tdb: 0.0, ra_cio: 0.0 }; 6];
+
+    // Cold: the first lookup after (re)installing the locator data
+    g.bench_function("cold", |b| {
+        b.iter_batched(install, |_| unsafe { sn::cio_array(JD0, 6, out.as_mut_ptr()) }, BatchSize::PerIteration)
+    });
+
+    // Warm: repeated lookups in the installed data
+    install();
+    g.bench_function("warm", |b| b.iter(|| unsafe { sn::cio_array(black_box(JD0), 6, out.as_mut_ptr()) }));
+    g.finish();
+}
+
+fn bench_state(c: &mut Criterion) {
+    // state() reads JPL DE binary files (not SPK), e.g. lnxp1600p2200.405
+    let Ok(path) = std::env::var("EPH_JPL") else {
+        eprintln!("Skipping state() benchmarks: set EPH_JPL to a JPL DE binary ephemeris file.");
+        return;
+    };
+
+    let file = CString::new(path).unwrap();
+    let (mut jd_begin, mut jd_end, mut de) = (0.0, 0.0, 0 as c_short);
+    if unsafe { ephem_open(file.as_ptr(), &mut jd_begin, &mut jd_end, &mut de) } != 0 {
+        die("could not open JPL DE ephemeris file");
+    }
+
+    let mut g = c.benchmark_group("state");
+    let (mut pos, mut vel) = ([0.0; 3], [0.0; 3]);
+
+    // Alternating between dates 100 days apart, i.e. in different records, with and without
+    // the record cache
+    for (label, cache) in [("switching/uncached", 1), ("switching/cached", 8)] {
+        unsafe { ephem_set_cache_size(cache) };
+        let mut k = 0u64;
+        g.bench_function(label, |b| {
+            b.iter(|| {
+                k += 1;
+                let jed = [JD0 + 100.0 * (k & 1) as f64, 0.0];
+                unsafe { state(jed.as_ptr(), 2, pos.as_mut_ptr(), vel.as_mut_ptr()) };
+                black_box(pos[0])
+            })
+        });
+    }
+
+    g.bench_function("same-record", |b| {
+        let jed = [JD0, 0.0];
+        b.iter(|| {
+            unsafe { state(jed.as_ptr(), 2, pos.as_mut_ptr(), vel.as_mut_ptr()) };
+            black_box(pos[0])
+        })
+    });
+    g.finish();
+
+    unsafe { ephem_close() };
+}
+
+fn bench_spk_readers(c: &mut Criterion) {
+    // Earth w.r.t. the SSB from the same DE405 data, via CALCEPH and CSPICE directly
+    let path = CString::new(DE405).unwrap();
+    let eph = unsafe { calceph_sys::calceph_open(path.as_ptr()) };
+    if eph.is_null() {
+        die("could not open DE405 with CALCEPH");
+    }
+    let frame = CString::new("J2000").unwrap();
+    use_cspice();
+
+    let mut g = c.benchmark_group("spk");
+    let mut pv = [0.0; 6];
+    let mut k = 0u64;
+
+    g.bench_function("calceph_compute_unit", |b| {
+        b.iter(|| {
+            k += 1;
+            unsafe {
+                calceph_sys::calceph_compute_unit(eph, JD0, k as f64 * 1e-3, 399, 0,
+                    (calceph_sys::CALCEPH_UNIT_KM | calceph_sys::CALCEPH_UNIT_SEC | calceph_sys::CALCEPH_USE_NAIFID) as _,
+                    pv.as_mut_ptr())
+            };
+            black_box(pv[0])
+        })
+    });
+
+    g.bench_function("spkgeo_c", |b| {
+        b.iter(|| {
+            let mut lt = 0.0;
+            k += 1;
+            let et = (JD0 - sn::NOVAS_JD_J2000 + k as f64 * 1e-3) * 86400.0;
+            unsafe { libcspice_sys::spkgeo_c(399, et, frame.as_ptr(), 0, pv.as_mut_ptr(), &mut lt) };
+            black_box(pv[0])
+        })
+    });
+    g.finish();
+
+    unsafe { calceph_sys::calceph_close(eph) };
+}
+
+// Runs `n` threads, each making `queries` planet queries via the current provider
+fn run_threads(n: usize, queries: u64) -> Duration {
+    let start = Instant::now();
+    thread::scope(|s| {
+        for k in 0..n {
+            s.spawn(move || {
+                let provider = unsafe { sn::get_planet_provider_hp() }.expect("no planet provider");
+                let (mut pos, mut vel) = ([0.0_f64; 3], [0.0_f64; 3]);
+                for i in 0..queries {
+                    let jd = [JD0, ((k as u64 * queries + i) as f64 * 1e-4) % 365.0];
+                    unsafe { provider(jd.as_ptr(), sn::novas_planet_NOVAS_MARS, sn::novas_origin_NOVAS_BARYCENTER,
+                        pos.as_mut_ptr(), vel.as_mut_ptr()) };
+                }
+                black_box(pos[0]);
+            });
+        }
+    });
+    start.elapsed()
+}
+
+fn bench_provider_scaling(c: &mut Criterion) {
+    let mut g = c.benchmark_group("provider_scaling");
+    g.sample_size(10);
+
+    for (label, setup) in [("calceph-shared", use_calceph_shared as fn()), ("calceph-per-thread", use_calceph_per_thread),
+        ("cspice", use_cspice)] {
+        setup();
+        for &n in THREAD_COUNTS.iter() {
+            g.throughput(Throughput::Elements(n as u64 * QUERIES_PER_THREAD));
+            g.bench_with_input(BenchmarkId::new(label, n), &n, |b, &n| {
+                b.iter_custom(|iters| (0..iters).map(|_| run_threads(n, QUERIES_PER_THREAD)).sum())
+            });
+        }
+    }
+    g.finish();
+}
+
+criterion_group!(benches, bench_make_frame, bench_sky_pos, bench_nutation, bench_cio_array, bench_state,
+    bench_spk_readers, bench_provider_scaling);
+criterion_main!(benches);
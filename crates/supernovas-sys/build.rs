@@ -4,6 +4,8 @@ use std::process::Command;
 use cc::Build;
 
 const SUPERNOVAS_DIR: &str = "SUPERNOVAS_DIR";
+#[cfg(feature = "novas-src")]
+const NO_DISPATCH: &str = "SUPERNOVAS_NO_DISPATCH";
 
 fn main() {
     println!("cargo:rerun-if-env-changed={}", SUPERNOVAS_DIR);
@@ -89,18 +91,20 @@ fn download_supernovas(dst: &PathBuf) {
     }
     fs::rename(&from, &to).expect("Failed to rename extracted directory");
 
-    // 将 vendor/SuperNOVAS/src 覆盖到 to.join("src")
-    let src_dir = to.join("src");
-    if src_dir.exists() {
-        fs::remove_dir_all(&src_dir).expect("Failed to remove existing src directory");
-    }
-    fs::create_dir_all(&src_dir).expect("Failed to create src directory");
-    let vendor_src_dir = PathBuf::from("vendor/SuperNOVAS/src");
-    for entry in fs::read_dir(vendor_src_dir).expect("Failed to read vendor src directory") {
-        let entry = entry.expect("Failed to read entry");
-        let path = entry.path();
-        if path.is_file() {
-            fs::copy(&path, src_dir.join(path.file_name().unwrap())).expect("Failed to copy file to src directory");
+    // 将 vendor/SuperNOVAS/src 和 vendor/SuperNOVAS/include 覆盖到下载的目录
+    for sub in ["src", "include"] {
+        let sub_dir = to.join(sub);
+        if sub_dir.exists() {
+            fs::remove_dir_all(&sub_dir).expect("Failed to remove existing vendor overlay directory");
+        }
+        fs::create_dir_all(&sub_dir).expect("Failed to create vendor overlay directory");
+        let vendor_sub_dir = PathBuf::from("vendor/SuperNOVAS").join(sub);
+        for entry in fs::read_dir(vendor_sub_dir).expect("Failed to read vendor directory") {
+            let entry = entry.expect("Failed to read entry");
+            let path = entry.path();
+            if path.is_file() {
+                fs::copy(&path, sub_dir.join(path.file_name().unwrap())).expect("Failed to copy file to vendor overlay directory");
+            }
         }
     }
 }
@@ -125,6 +129,31 @@ fn build_supernovas(supernovas_dir: &PathBuf) {
 
     cfg.warnings(false).out_dir(&lib).include(supernovas_dir.join("include"));
 
+    // Per-thread counters and timers for the library's hot paths
+    #[cfg(feature = "instrument")]
+    cfg.define("NOVAS_INSTRUMENT", "1");
+
+    // Specialize the library for a single accuracy, resolving accuracy-dependent branches at compile time
+    #[cfg(all(feature = "full-accuracy-only", feature = "reduced-accuracy-only"))]
+    compile_error!("features `full-accuracy-only` and `reduced-accuracy-only` are mutually exclusive");
+    #[cfg(feature = "full-accuracy-only")]
+    cfg.define("NOVAS_FIXED_ACCURACY", "NOVAS_FULL_ACCURACY");
+    #[cfg(feature = "reduced-accuracy-only")]
+    cfg.define("NOVAS_FIXED_ACCURACY", "NOVAS_REDUCED_ACCURACY");
+
+    // AVX2 / AVX-512 variants of the vectorizable kernels, selected for the CPU at load time (via
+    // ifunc, which needs glibc). Contraction into FMA is disabled, so that every variant returns
+    // the same results, bit for bit. Set SUPERNOVAS_NO_DISPATCH to build the baseline only.
+    // (On aarch64, NEON is part of the baseline ISA already.)
+    println!("cargo:rerun-if-env-changed={}", NO_DISPATCH);
+    if target.starts_with("x86_64") && target.contains("linux-gnu") && env::var_os(NO_DISPATCH).is_none() {
+        cfg.define("NOVAS_DISPATCH", "1").flag_if_supported("-ffp-contract=off");
+    }
+
+    // Math functions need not set errno (the library reports its own errors), s.t. loops that call
+    // sqrt(), such as the spherical array conversions, can be vectorized.
+    cfg.flag_if_supported("-fno-math-errno");
+
     let src_files: Vec<_> = fs::read_dir(supernovas_dir.join("src"))
     .unwrap()
     .filter_map(|entry| {
@@ -168,6 +197,11 @@ fn build_supernovas(supernovas_dir: &PathBuf) {
         println!("cargo:rustc-link-arg=/DEFAULTLIB:{}.lib", runtime_lib);
     }
 
+    if target.contains("linux") {
+        // shm_open() / shm_unlink() live in librt on glibc < 2.34
+        println!("cargo:rustc-link-lib=rt");
+    }
+
     cfg.compile("supernovas");
     let src_include = supernovas_dir.join("include");
     let dst_include = dst.join("include");
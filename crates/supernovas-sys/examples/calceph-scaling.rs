@@ -0,0 +1,89 @@
+use std::env;
+use std::ffi::CString;
+use std::os::raw::c_char;
+use std::thread;
+use std::time::Instant;
+use supernovas_sys as sn;
+
+const QUERIES_PER_THREAD: usize = 200_000; // planet queries per worker thread
+const THREAD_COUNTS: [usize; 6] = [1, 2, 4, 8, 16, 32];
+
+// Runs `n` worker threads, each querying Mars positions at different epochs, and returns the
+// aggregate throughput in queries per second.
+fn run(n: usize) -> f64 {
+    let start = Instant::now();
+
+    let workers: Vec<_> = (0..n)
+        .map(|k| {
+            thread::spawn(move || {
+                let provider = unsafe { sn::get_planet_provider_hp() }.expect("no planet provider");
+                let mut pos = [0.0_f64; 3];
+                let mut vel = [0.0_f64; 3];
+
+                for i in 0..QUERIES_PER_THREAD {
+                    // Spread epochs over a year, offset per thread
+                    let jd = [2460000.5, (k * QUERIES_PER_THREAD + i) as f64 * 1e-4 % 365.0];
+                    let res = unsafe {
+                        provider(
+                            jd.as_ptr(),
+                            sn::novas_planet_NOVAS_MARS,
+                            sn::novas_origin_NOVAS_BARYCENTER,
+                            pos.as_mut_ptr(),
+                            vel.as_mut_ptr(),
+                        )
+                    };
+                    if res != 0 {
+                        eprintln!("ERROR! planet query failed: {}", res);
+                        std::process::exit(1);
+                    }
+                }
+            })
+        })
+        .collect();
+
+    for w in workers {
+        w.join().unwrap();
+    }
+
+    (n * QUERIES_PER_THREAD) as f64 / start.elapsed().as_secs_f64()
+}
+
+fn main() {
+    // Ephemeris files to use, e.g. the DE440s file as in the calceph example
+    let args: Vec<String> = env::args().skip(1).collect();
+    let paths: Vec<String> = if args.is_empty() {
+        vec![env::var("EPH_DE440S").expect("Set EPH_DE440S or pass ephemeris files as arguments")]
+    } else {
+        args
+    };
+
+    let files: Vec<CString> = paths.iter().map(|p| CString::new(p.as_str()).unwrap()).collect();
+    let ptrs: Vec<*const c_char> = files.iter().map(|f| f.as_ptr()).collect();
+
+    // Baseline: a single shared CALCEPH instance (locked if CALCEPH is not thread-safe for it)
+    let eph = unsafe { sn::calceph_open_array(ptrs.len() as i32, ptrs.as_ptr()) };
+    if eph.is_null() || unsafe { sn::novas_use_calceph_planets(eph) } != 0 {
+        eprintln!("ERROR! could not open ephemeris data");
+        std::process::exit(1);
+    }
+
+    println!("threads   shared [q/s]   lock-free [q/s]   speedup");
+
+    let mut shared = Vec::new();
+    for &n in THREAD_COUNTS.iter() {
+        shared.push(run(n));
+    }
+
+    // Lock-free: a shared instance if thread-safe, or else per-thread instances
+    if unsafe { sn::novas_use_calceph_planet_files(ptrs.as_ptr(), ptrs.len() as i32) } != 0 {
+        eprintln!("ERROR! could not set up per-thread ephemeris access");
+        std::process::exit(1);
+    }
+
+    for (i, &n) in THREAD_COUNTS.iter().enumerate() {
+        let lock_free = run(n);
+        println!("{:7} {:14.0} {:17.0} {:9.2}", n, shared[i], lock_free, lock_free / shared[i]);
+    }
+
+    unsafe { sn::calceph_close(eph) };
+}
@@ -0,0 +1,86 @@
+use std::env;
+use std::thread;
+use std::time::Instant;
+use supernovas_sys as sn;
+
+const ROWS: usize = 5_000_000; // number of catalog rows to re-epoch
+const EPOCH_IN: f64 = 2016.0;  // [yr] Gaia DR3 reference epoch
+const EPOCH_OUT: f64 = 2000.0; // [yr] output epoch
+
+// Catalog columns, each in its own contiguous array
+struct Columns {
+    ra: Vec<f64>,
+    dec: Vec<f64>,
+    pm_ra: Vec<f64>,
+    pm_dec: Vec<f64>,
+    parallax: Vec<f64>,
+    rv: Vec<f64>,
+}
+
+fn main() {
+    // Number of worker threads
+    let threads: usize = env::args().nth(1).and_then(|s| s.parse().ok()).unwrap_or(4).max(1);
+
+    // Pseudo-random catalog, spread all over the sky
+    let mut seed: u64 = 12345;
+    let mut rand = || {
+        seed = seed.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407);
+        (seed >> 11) as f64 / (1u64 << 53) as f64
+    };
+
+    let mut cat = Columns {
+        ra: Vec::with_capacity(ROWS),
+        dec: Vec::with_capacity(ROWS),
+        pm_ra: Vec::with_capacity(ROWS),
+        pm_dec: Vec::with_capacity(ROWS),
+        parallax: Vec::with_capacity(ROWS),
+        rv: Vec::with_capacity(ROWS),
+    };
+
+    for _ in 0..ROWS {
+        cat.ra.push(24.0 * rand());
+        cat.dec.push(180.0 * rand() - 90.0);
+        cat.pm_ra.push(20.0 * rand() - 10.0);
+        cat.pm_dec.push(20.0 * rand() - 10.0);
+        cat.parallax.push(5.0 * rand());
+        cat.rv.push(0.0);
+    }
+
+    // Re-epoch the catalog in place, with each thread transforming its own chunk of rows
+    let chunk = ROWS.div_ceil(threads);
+    let start = Instant::now();
+
+    thread::scope(|s| {
+        for (((((ra, dec), pm_ra), pm_dec), parallax), rv) in cat.ra.chunks_mut(chunk)
+            .zip(cat.dec.chunks_mut(chunk))
+            .zip(cat.pm_ra.chunks_mut(chunk))
+            .zip(cat.pm_dec.chunks_mut(chunk))
+            .zip(cat.parallax.chunks_mut(chunk))
+            .zip(cat.rv.chunks_mut(chunk)) {
+            s.spawn(move || {
+                let mut cols = sn::novas_cat_columns {
+                    ra: ra.as_mut_ptr(),
+                    dec: dec.as_mut_ptr(),
+                    promora: pm_ra.as_mut_ptr(),
+                    promodec: pm_dec.as_mut_ptr(),
+                    parallax: parallax.as_mut_ptr(),
+                    radialvelocity: rv.as_mut_ptr(),
+                };
+                // Input and output are the same columns
+                let p: *mut sn::novas_cat_columns = &mut cols;
+                let res = unsafe {
+                    sn::transform_cat_columns(sn::novas_transform_type_CHANGE_EPOCH, EPOCH_IN, p,
+                        ra.len() as i32, EPOCH_OUT, p)
+                };
+                if res != 0 {
+                    eprintln!("ERROR! catalog transformation failed: {}", res);
+                    std::process::exit(1);
+                }
+            });
+        }
+    });
+
+    let elapsed = start.elapsed().as_secs_f64();
+    println!("{} rows re-epoched from J{:.1} to J{:.1} with {} threads in {:.1} ms ({:.1} M rows/s)",
+        ROWS, EPOCH_IN, EPOCH_OUT, threads, elapsed * 1e3, ROWS as f64 / elapsed * 1e-6);
+}
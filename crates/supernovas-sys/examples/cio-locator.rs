@@ -0,0 +1,63 @@
+use std::env;
+use std::ffi::CString;
+use std::thread;
+use std::time::Instant;
+use supernovas_sys as sn;
+
+const JD_START: f64 = 2378496.5; // [day] 1800-01-01
+const JD_END: f64 = 2524593.5;   // [day] 2200-01-01
+const INTERVAL: f64 = 1.2;       // [day] record spacing, same as CIO_RA.TXT
+
+fn main() {
+    // Number of worker threads, and an optional binary locator file to save the table to
+    let args: Vec<String> = env::args().skip(1).collect();
+    let threads: usize = args.first().and_then(|s| s.parse().ok()).unwrap_or(4).max(1);
+
+    let n = ((JD_END - JD_START) / INTERVAL).ceil() as usize + 1;
+    let mut recs = vec![sn::ra_of_cio { jd_tdb: 0.0, ra_cio: 0.0 }; n];
+    let chunk = n.div_ceil(threads);
+
+    // Calculate the CIO locator table, with each thread calculating its own chunk of records
+    let start = Instant::now();
+    thread::scope(|s| {
+        for (k, part) in recs.chunks_mut(chunk).enumerate() {
+            s.spawn(move || {
+                let jd0 = JD_START + (k * chunk) as f64 * INTERVAL;
+                let res = unsafe {
+                    sn::novas_make_cio_locator(sn::novas_accuracy_NOVAS_FULL_ACCURACY, jd0, INTERVAL,
+                        part.len() as _, part.as_mut_ptr())
+                };
+                if res != 0 {
+                    eprintln!("ERROR! calculating CIO locator records: {}", res);
+                    std::process::exit(1);
+                }
+            });
+        }
+    });
+    println!("{} CIO locator records calculated with {} threads in {:.1} ms", n, threads,
+        start.elapsed().as_secs_f64() * 1e3);
+
+    unsafe {
+        // Use the table directly, without a locator file
+        if sn::novas_set_cio_locator_data(recs.as_ptr(), n as _) != 0 {
+            eprintln!("ERROR! setting CIO locator data.");
+            std::process::exit(1);
+        }
+
+        // Optionally, save it as a binary locator file also
+        if let Some(path) = args.get(1) {
+            let file = CString::new(path.as_str()).unwrap();
+            if sn::novas_write_cio_locator(file.as_ptr(), recs.as_ptr(), n as _) != 0 {
+                eprintln!("ERROR! writing CIO locator file {}", path);
+                std::process::exit(1);
+            }
+            println!("Saved CIO locator data to {}", path);
+        }
+
+        // CIO location for J2000, now interpolated from the table
+        let mut ra = 0.0_f64;
+        let mut loc_type: i16 = -1;
+        sn::cio_location(sn::NOVAS_JD_J2000, sn::novas_accuracy_NOVAS_FULL_ACCURACY, &mut ra, &mut loc_type);
+        println!("CIO RA at J2000: {:.3} mas (location type {})", ra * 15.0 * 3600e3, loc_type);
+    }
+}
@@ -0,0 +1,100 @@
+use std::env;
+use std::ffi::CString;
+use std::time::Instant;
+use supernovas_sys as sn;
+
+const TOLERANCE: f64 = 1.0; // [m] maximum position error of the packed records
+
+fn main() {
+    // Output file, and the years to cover (default 2020 to 2040)
+    let args: Vec<String> = env::args().skip(1).collect();
+    let Some(out) = args.first() else {
+        eprintln!("Usage: ephem-subset <output-file> [from-year] [to-year]");
+        std::process::exit(1);
+    };
+    let from: i16 = args.get(1).and_then(|s| s.parse().ok()).unwrap_or(2020);
+    let to: i16 = args.get(2).and_then(|s| s.parse().ok()).unwrap_or(2040);
+
+    // Open the full ephemeris file with CALCEPH
+    let ephem_path = CString::new(env::var("EPH_DE440S").unwrap()).unwrap();
+    let de440 = unsafe { sn::calceph_open(ephem_path.as_ptr()) };
+    if de440.is_null() {
+        eprintln!("ERROR! could not open ephemeris data");
+        std::process::exit(1);
+    }
+    unsafe { sn::novas_use_calceph_planets(de440) };
+
+    // The bodies to extract: Sun, Moon, Earth-Moon Barycenter and Jupiter
+    let ids = [
+        sn::novas_planet_NOVAS_SUN,
+        sn::novas_planet_NOVAS_MOON,
+        sn::novas_planet_NOVAS_EMB,
+        sn::novas_planet_NOVAS_JUPITER,
+    ];
+    let mut bodies = vec![sn::object::default(); ids.len()];
+    for (body, &id) in bodies.iter_mut().zip(ids.iter()) {
+        if unsafe { sn::make_planet(id, body) } != 0 {
+            eprintln!("ERROR! defining planet {}", id);
+            std::process::exit(1);
+        }
+    }
+
+    let jd_start = unsafe { sn::julian_date(from, 1, 1, 0.0) };
+    let jd_end = unsafe { sn::julian_date(to + 1, 1, 1, 0.0) };
+
+    // Fit and write the compact subset
+    let file = CString::new(out.as_str()).unwrap();
+    let start = Instant::now();
+    let res = unsafe {
+        sn::novas_write_ephem_subset(file.as_ptr(), bodies.as_ptr(), bodies.len() as _, jd_start, jd_end, TOLERANCE)
+    };
+    if res != 0 {
+        eprintln!("ERROR! writing ephemeris subset {}", out);
+        std::process::exit(1);
+    }
+    let size = std::fs::metadata(out).map(|m| m.len()).unwrap_or(0);
+    println!("Wrote {} ({:.1} kB) for {}-{} in {:.1} s", out, size as f64 / 1024.0, from, to,
+        start.elapsed().as_secs_f64());
+
+    // Compare states from the subset against CALCEPH, at times across the span
+    let times: Vec<[f64; 2]> = (0..1000)
+        .map(|k| [jd_start, (jd_end - jd_start) * (k as f64 + 0.5) / 1000.0])
+        .collect();
+    let mut vel = [0.0_f64; 3];
+    let mut reference = vec![[0.0_f64; 3]; times.len() * bodies.len()];
+
+    for (k, tdb) in times.iter().enumerate() {
+        for (j, body) in bodies.iter().enumerate() {
+            unsafe {
+                sn::ephemeris(tdb.as_ptr(), body, sn::novas_origin_NOVAS_BARYCENTER,
+                    sn::novas_accuracy_NOVAS_FULL_ACCURACY, reference[k * bodies.len() + j].as_mut_ptr(),
+                    vel.as_mut_ptr());
+            }
+        }
+    }
+
+    // Now serve the same bodies from the memory-mapped subset
+    if unsafe { sn::novas_use_ephem_subset(file.as_ptr()) } != 0 {
+        eprintln!("ERROR! using ephemeris subset {}", out);
+        std::process::exit(1);
+    }
+
+    let mut pos = [0.0_f64; 3];
+    let mut max_err = 0.0_f64;
+    let start = Instant::now();
+
+    for (k, tdb) in times.iter().enumerate() {
+        for (j, body) in bodies.iter().enumerate() {
+            unsafe {
+                sn::ephemeris(tdb.as_ptr(), body, sn::novas_origin_NOVAS_BARYCENTER,
+                    sn::novas_accuracy_NOVAS_FULL_ACCURACY, pos.as_mut_ptr(), vel.as_mut_ptr());
+            }
+            let p0 = &reference[k * bodies.len() + j];
+            let d: f64 = (0..3).map(|i| (pos[i] - p0[i]).powi(2)).sum::<f64>().sqrt();
+            max_err = max_err.max(d * sn::NOVAS_AU);
+        }
+    }
+
+    println!("{} states from the subset in {:.1} ms, largest deviation from the full ephemeris: {:.3} m",
+        reference.len(), start.elapsed().as_secs_f64() * 1e3, max_err);
+}
@@ -0,0 +1,332 @@
+use std::env;
+use std::ffi::CString;
+use std::thread;
+use std::time::{Duration, Instant};
+use supernovas_sys as sn;
+
+// DE405 test kernel shared with libcspice-sys, readable both by CALCEPH and CSPICE
+const DE405: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../libcspice-sys/tests/data/de405.bsp");
+
+const LEAP_SECONDS: i32 = 37;  // [s] leap seconds
+const DUT1: f64 = 0.114;       // [s] UT1 - UTC time difference
+const JD0: f64 = 2460676.5;    // [day] 2025-01-01 (TT), well inside DE405
+const SPAN: f64 = 30.0;        // [day] span of the random times of the operations
+const EL: f64 = 10.0;          // [deg] elevation limit for rise / set times
+const DEFAULT_MIX: &str = "frame:2,sky:10,track:4,rise:1";
+
+// Latency histogram, with 16 logarithmic bins per octave of nanoseconds (< 4.5% resolution)
+const SUB_BITS: u32 = 4;
+const BINS: usize = 64 << SUB_BITS;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum Op {
+    Frame,
+    Sky,
+    Track,
+    Rise,
+}
+
+const OPS: [Op; 4] = [Op::Frame, Op::Sky, Op::Track, Op::Rise];
+
+impl Op {
+    fn name(self) -> &'static str {
+        match self {
+            Op::Frame => "frame",
+            Op::Sky => "sky",
+            Op::Track => "track",
+            Op::Rise => "rise",
+        }
+    }
+}
+
+#[derive(Clone)]
+struct Histogram {
+    bins: Vec<u64>,
+    count: u64,
+    total: u128,
+    max: u64,
+}
+
+impl Histogram {
+    fn new() -> Histogram {
+        Histogram { bins: vec![0; BINS], count: 0, total: 0, max: 0 }
+    }
+
+    fn bin(ns: u64) -> usize {
+        if ns < (1 << SUB_BITS) {
+            return ns as usize;
+        }
+        let octave = 63 - ns.leading_zeros();
+        let sub = (ns >> (octave - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+        (((octave - SUB_BITS + 1) << SUB_BITS) as u64 + sub) as usize
+    }
+
+    // Upper edge of a bin [ns]
+    fn edge(bin: usize) -> u64 {
+        if bin < (1 << SUB_BITS) {
+            return bin as u64;
+        }
+        let octave = (bin >> SUB_BITS) as u32 + SUB_BITS - 1;
+        let sub = (bin & ((1 << SUB_BITS) - 1)) as u64;
+        ((1 << SUB_BITS) + sub + 1) << (octave - SUB_BITS)
+    }
+
+    fn record(&mut self, ns: u64) {
+        self.bins[Histogram::bin(ns)] += 1;
+        self.count += 1;
+        self.total += ns as u128;
+        self.max = self.max.max(ns);
+    }
+
+    fn merge(&mut self, other: &Histogram) {
+        for (a, b) in self.bins.iter_mut().zip(&other.bins) {
+            *a += b;
+        }
+        self.count += other.count;
+        self.total += other.total;
+        self.max = self.max.max(other.max);
+    }
+
+    fn percentile(&self, p: f64) -> u64 {
+        let target = ((p / 100.0) * self.count as f64).ceil().max(1.0) as u64;
+        let mut sum = 0;
+        for (i, n) in self.bins.iter().enumerate() {
+            sum += n;
+            if sum >= target {
+                return Histogram::edge(i).min(self.max);
+            }
+        }
+        self.max
+    }
+}
+
+fn die(msg: &str) -> ! {
+    eprintln!("ERROR! {}", msg);
+    std::process::exit(1);
+}
+
+fn usage() -> ! {
+    eprintln!("Usage: load-test <threads> [seconds] [calceph | calceph-threads | cspice] [mix]");
+    eprintln!("  mix: weights of the operations, e.g. '{}'", DEFAULT_MIX);
+    std::process::exit(1);
+}
+
+fn parse_mix(spec: &str) -> Vec<(Op, u32)> {
+    let mut mix = Vec::new();
+    for term in spec.split(',') {
+        let (name, weight) = term.split_once(':').unwrap_or_else(|| usage());
+        let op = OPS.iter().copied().find(|op| op.name() == name.trim()).unwrap_or_else(|| usage());
+        let weight: u32 = weight.trim().parse().unwrap_or_else(|_| usage());
+        if weight > 0 {
+            mix.push((op, weight));
+        }
+    }
+    if mix.is_empty() {
+        usage();
+    }
+    mix
+}
+
+fn use_provider(provider: &str) {
+    let path = CString::new(DE405).unwrap();
+    let res = unsafe {
+        match provider {
+            "calceph" => {
+                let eph = sn::calceph_open(path.as_ptr());
+                if eph.is_null() { -1 } else { sn::novas_use_calceph(eph) }
+            }
+            "calceph-threads" => {
+                let files = [path.as_ptr()];
+                sn::novas_use_calceph_files(files.as_ptr(), 1)
+            }
+            "cspice" => {
+                if sn::cspice_add_kernel(path.as_ptr()) != 0 { -1 } else { sn::novas_use_cspice() }
+            }
+            _ => usage(),
+        }
+    };
+    if res != 0 {
+        die(&format!("could not use DE405 via {}", provider));
+    }
+}
+
+struct Worker {
+    rand: u64,
+    obs: sn::observer,
+    frame: sn::novas_frame,
+    sources: Vec<sn::object>,
+}
+
+impl Worker {
+    fn new(seed: u64) -> Worker {
+        let mut w = Worker {
+            rand: seed,
+            obs: unsafe { std::mem::zeroed() },
+            frame: unsafe { std::mem::zeroed() },
+            sources: Vec::new(),
+        };
+
+        unsafe {
+            if sn::make_observer_on_surface(50.7374, 7.0982, 60.0, 10.0, 1000.0, &mut w.obs) != 0 {
+                die("failed to define observer");
+            }
+
+            // Planets and the Moon from the ephemeris provider, and a star
+            for planet in [sn::novas_planet_NOVAS_MOON, sn::novas_planet_NOVAS_MARS, sn::novas_planet_NOVAS_JUPITER,
+                sn::novas_planet_NOVAS_VENUS] {
+                let mut source: sn::object = std::mem::zeroed();
+                if sn::make_planet(planet, &mut source) != 0 {
+                    die("failed to define planet");
+                }
+                w.sources.push(source);
+            }
+
+            let name = CString::new("Antares").unwrap();
+            let catalog = CString::new("HIP").unwrap();
+            let mut star: sn::cat_entry = std::mem::zeroed();
+            let mut source: sn::object = std::mem::zeroed();
+            if sn::make_cat_entry(name.as_ptr(), catalog.as_ptr(), 80763, 16.490128, -26.432002, -12.11, -23.30,
+                5.89, -3.4, &mut star) != 0 || sn::make_cat_object(&star, &mut source) != 0 {
+                die("failed to define star");
+            }
+            w.sources.push(source);
+        }
+
+        w.new_frame();
+        w
+    }
+
+    fn uniform(&mut self) -> f64 {
+        self.rand = self.rand.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407);
+        (self.rand >> 11) as f64 / (1u64 << 53) as f64
+    }
+
+    fn source(&mut self) -> sn::object {
+        let i = (self.uniform() * self.sources.len() as f64) as usize;
+        self.sources[i.min(self.sources.len() - 1)]
+    }
+
+    // A full-accuracy frame at a random time
+    fn new_frame(&mut self) {
+        let jd = JD0 + SPAN * self.uniform();
+        unsafe {
+            let mut time: sn::novas_timespec = std::mem::zeroed();
+            if sn::novas_set_time(sn::novas_timescale_NOVAS_TT, jd, LEAP_SECONDS, DUT1, &mut time) != 0 {
+                die("failed to set time");
+            }
+            if sn::novas_make_frame(sn::novas_accuracy_NOVAS_FULL_ACCURACY, &self.obs, &time, 0.0, 0.0,
+                &mut self.frame) != 0 {
+                die(&format!("failed to make frame for JD {}", jd));
+            }
+        }
+    }
+
+    fn run(&mut self, op: Op) {
+        let source = self.source();
+        unsafe {
+            match op {
+                Op::Frame => self.new_frame(),
+                Op::Sky => {
+                    let mut pos: sn::sky_pos = std::mem::zeroed();
+                    if sn::novas_sky_pos(&source, &self.frame, sn::novas_reference_system_NOVAS_TOD, &mut pos) != 0 {
+                        die("novas_sky_pos() failed");
+                    }
+                }
+                Op::Track => {
+                    let mut track: sn::novas_track = std::mem::zeroed();
+                    if sn::novas_hor_track(&source, &self.frame, Some(sn::novas_standard_refraction), &mut track) != 0 {
+                        die("novas_hor_track() failed");
+                    }
+                }
+                Op::Rise => {
+                    // NaN is a valid result, for circumpolar or never rising sources
+                    let _ = sn::novas_rises_above(EL, &source, &self.frame, Some(sn::novas_standard_refraction));
+                }
+            }
+        }
+    }
+}
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    let threads: usize = args.get(1).and_then(|s| s.parse().ok()).unwrap_or_else(|| usage()).max(1);
+    let seconds: f64 = args.get(2).map(|s| s.parse().unwrap_or_else(|_| usage())).unwrap_or(10.0);
+    let provider = args.get(3).map(String::as_str).unwrap_or("calceph");
+    let mix = parse_mix(args.get(4).map(String::as_str).unwrap_or(DEFAULT_MIX));
+    let weights: u32 = mix.iter().map(|(_, w)| w).sum();
+
+    use_provider(provider);
+
+    println!("{} threads for {:.0} s, DE405 via {}, mix {:?}", threads, seconds, provider, mix);
+
+    // Run the mix on all threads, each with its own frame, recording the latency of every call
+    let duration = Duration::from_secs_f64(seconds);
+    let results: Vec<(Vec<Histogram>, [sn::novas_probe_stats; supernovas_sys::probes::COUNT])> = thread::scope(|s| {
+        let workers: Vec<_> = (0..threads).map(|id| {
+            let mix = &mix;
+            s.spawn(move || {
+                let mut worker = Worker::new(12345 + 7919 * id as u64);
+                let mut hist = vec![Histogram::new(); OPS.len()];
+
+                supernovas_sys::probes::reset();
+                let start = Instant::now();
+
+                while start.elapsed() < duration {
+                    let mut pick = (worker.uniform() * weights as f64) as u32;
+                    let mut op = mix[mix.len() - 1].0;
+                    for &(o, w) in mix.iter() {
+                        if pick < w {
+                            op = o;
+                            break;
+                        }
+                        pick -= w;
+                    }
+
+                    let t = Instant::now();
+                    worker.run(op);
+                    hist[op as usize].record(t.elapsed().as_nanos() as u64);
+                }
+
+                (hist, supernovas_sys::probes::snapshot().map(|(_, stats)| stats))
+            })
+        }).collect();
+        workers.into_iter().map(|w| w.join().unwrap()).collect()
+    });
+
+    let mut total = vec![Histogram::new(); OPS.len()];
+    let mut probes = [sn::novas_probe_stats { calls: 0, nanos: 0 }; supernovas_sys::probes::COUNT];
+    for (hist, stats) in &results {
+        for (t, h) in total.iter_mut().zip(hist) {
+            t.merge(h);
+        }
+        for (p, s) in probes.iter_mut().zip(stats) {
+            p.calls += s.calls;
+            p.nanos += s.nanos;
+        }
+    }
+
+    println!();
+    println!("{:<8} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}", "op", "calls", "calls/s", "mean [us]",
+        "p50 [us]", "p99 [us]", "p99.9 [us]", "max [us]");
+    for op in OPS {
+        let h = &total[op as usize];
+        if h.count == 0 {
+            continue;
+        }
+        println!("{:<8} {:>10} {:>10.0} {:>10.2} {:>10.2} {:>10.2} {:>10.2} {:>10.2}", op.name(), h.count,
+            h.count as f64 / seconds, h.total as f64 / h.count as f64 * 1e-3, h.percentile(50.0) as f64 * 1e-3,
+            h.percentile(99.0) as f64 * 1e-3, h.percentile(99.9) as f64 * 1e-3, h.max as f64 * 1e-3);
+    }
+
+    // Where the time went, if built with the `instrument` feature
+    let names = supernovas_sys::probes::snapshot().map(|(name, _)| name);
+    if probes.iter().any(|p| p.calls > 0) {
+        println!();
+        println!("{:<24} {:>12} {:>12}", "probe", "calls", "total [ms]");
+        for (name, p) in names.iter().zip(&probes) {
+            if p.calls > 0 {
+                println!("{:<24} {:>12} {:>12.1}", name, p.calls, p.nanos as f64 * 1e-6);
+            }
+        }
+    }
+}
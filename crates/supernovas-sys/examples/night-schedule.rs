@@ -0,0 +1,103 @@
+use std::env;
+use std::thread;
+use std::time::{Instant, SystemTime, UNIX_EPOCH};
+use supernovas_sys as sn;
+
+const LEAP_SECONDS: i32 = 37; // [s] current leap seconds from IERS Bulletin C
+const DUT1: f64 = 0.114;      // [s] current UT1 - UTC time difference from IERS Bulletin A
+const POLAR_DX: f64 = 230.0;  // [mas] Earth polar offset x
+const POLAR_DY: f64 = -62.0;  // [mas] Earth polar offset y
+const TARGETS: usize = 50_000; // number of catalog targets to plan
+const EL: f64 = 15.0;          // [deg] elevation limit for rise / set times
+
+// The frame grid is only read while scheduling, so threads may share it.
+struct SharedGrid(sn::novas_frame_grid);
+unsafe impl Sync for SharedGrid {}
+
+fn main() {
+    // Number of worker threads
+    let threads: usize = env::args().nth(1).and_then(|s| s.parse().ok()).unwrap_or(4).max(1);
+
+    unsafe {
+        // Pseudo-random target list, spread all over the sky
+        let mut seed: u64 = 12345;
+        let mut rand = || {
+            seed = seed.wrapping_mul(6364136223846793005).wrapping_add(1442695040888963407);
+            (seed >> 11) as f64 / (1u64 << 53) as f64
+        };
+
+        let mut sources: Vec<sn::object> = Vec::with_capacity(TARGETS);
+        for i in 0..TARGETS {
+            let mut star: sn::cat_entry = std::mem::zeroed();
+            let mut source: sn::object = std::mem::zeroed();
+            let name = std::ffi::CString::new(format!("T{}", i)).unwrap();
+            let catalog = std::ffi::CString::new("RND").unwrap();
+            if sn::make_cat_entry(name.as_ptr(), catalog.as_ptr(), i as _, 24.0 * rand(), 180.0 * rand() - 90.0,
+                0.0, 0.0, 0.0, 0.0, &mut star) != 0 || sn::make_cat_object(&star, &mut source) != 0 {
+                eprintln!("ERROR! defining target {}", i);
+                std::process::exit(1);
+            }
+            sources.push(source);
+        }
+
+        // Observer location (Bonn, Germany)
+        let mut obs: sn::observer = std::mem::zeroed();
+        if sn::make_observer_on_surface(50.7374, 7.0982, 60.0, 0.0, 0.0, &mut obs) != 0 {
+            eprintln!("ERROR! defining Earth-based observer location.");
+            std::process::exit(1);
+        }
+
+        // Start planning from the current time
+        let now = SystemTime::now().duration_since(UNIX_EPOCH).unwrap();
+        let mut obs_time: sn::novas_timespec = std::mem::zeroed();
+        if sn::novas_set_unix_time(now.as_secs() as i64, now.subsec_nanos() as i32, LEAP_SECONDS, DUT1, &mut obs_time) != 0 {
+            eprintln!("ERROR! failed to set time of observation.");
+            std::process::exit(1);
+        }
+
+        let mut obs_frame: sn::novas_frame = std::mem::zeroed();
+        if sn::novas_make_frame(sn::novas_accuracy_NOVAS_REDUCED_ACCURACY, &obs, &obs_time, POLAR_DX, POLAR_DY,
+            &mut obs_frame) != 0 {
+            eprintln!("ERROR! failed to define observing frame.");
+            std::process::exit(1);
+        }
+
+        // Frames for the night ahead, at the default interval
+        let start = Instant::now();
+        let mut grid = SharedGrid(std::mem::zeroed());
+        if sn::novas_make_frame_grid(&obs_frame, 0.0, &mut grid.0) != 0 {
+            eprintln!("ERROR! failed to create frame grid.");
+            std::process::exit(1);
+        }
+        println!("Frame grid: {} frames in {:.1} ms", grid.0.n, start.elapsed().as_secs_f64() * 1e3);
+
+        // Rise, transit and set times for all targets, split between the threads
+        let mut rise = vec![0.0_f64; TARGETS];
+        let mut transit = vec![0.0_f64; TARGETS];
+        let mut set = vec![0.0_f64; TARGETS];
+        let chunk = TARGETS.div_ceil(threads);
+
+        let start = Instant::now();
+        thread::scope(|s| {
+            let grid = &grid;
+            for (((src, r), t), z) in sources.chunks(chunk).zip(rise.chunks_mut(chunk)).zip(transit.chunks_mut(chunk))
+                .zip(set.chunks_mut(chunk)) {
+                s.spawn(move || {
+                    let res = sn::novas_schedule_events(&grid.0, src.as_ptr(), src.len() as i32, EL,
+                        Some(sn::novas_standard_refraction), r.as_mut_ptr(), t.as_mut_ptr(), z.as_mut_ptr());
+                    if res != 0 {
+                        eprintln!("ERROR! scheduling failed: {}", res);
+                        std::process::exit(1);
+                    }
+                });
+            }
+        });
+        let elapsed = start.elapsed().as_secs_f64();
+
+        let visible = rise.iter().zip(set.iter()).filter(|(r, s)| !r.is_nan() || !s.is_nan()).count();
+        println!("{} targets ({} rising / setting at {:.0} deg) planned with {} threads in {:.1} ms",
+            TARGETS, visible, EL, threads, elapsed * 1e3);
+
+        sn::novas_free_frame_grid(&mut grid.0);
+    }
+}
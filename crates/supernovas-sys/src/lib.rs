@@ -41,4 +41,28 @@ pub mod utils {
             write!(f, "{:02}° {:02}′ {:02.2}″", d, m, s)
         }
     }
-}
\ No newline at end of file
+}
+
+pub mod probes {
+    use super::*;
+
+    // Number of instrumented hot paths, i.e. NOVAS_PROBES
+    pub const COUNT: usize = novas_probe_NOVAS_PROBE_CSPICE_LOCK as usize + 1;
+
+    // Snapshot of the calling thread's hot-path counters, with the name of each probe, e.g. for
+    // exporting as metrics. All counters are zero unless built with the `instrument` feature.
+    pub fn snapshot() -> [(&'static str, novas_probe_stats); COUNT] {
+        let mut stats = [novas_probe_stats { calls: 0, nanos: 0 }; COUNT];
+        unsafe { novas_get_probes(stats.as_mut_ptr(), COUNT as i32) };
+
+        std::array::from_fn(|i| {
+            let name = unsafe { std::ffi::CStr::from_ptr(novas_probe_name(i as novas_probe)) };
+            (name.to_str().unwrap_or(""), stats[i])
+        })
+    }
+
+    // Resets the calling thread's hot-path counters
+    pub fn reset() {
+        unsafe { novas_reset_probes() };
+    }
+}
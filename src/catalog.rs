@@ -0,0 +1,557 @@
+//! Streaming catalog reader, feeding the columnar astrometry of [`sky`](crate::sky).
+//!
+//! A [`CatalogReader`] reads a catalog file in large blocks of whole rows, straight into
+//! [`StarColumns`], without building a `cat_entry` (with its name copies and validation) per
+//! star. The positions are moved from the catalog epoch to the epoch J2000 expected by the
+//! astrometry, column-wise, via `transform_cat_columns()`.
+//!
+//! [`CatalogReader::sky_pos_stream()`] pipelines the work over threads: one thread reads the
+//! blocks from the file, while the others parse them, change their epoch and calculate their
+//! apparent positions, and the results are passed to the caller, in file order, on the calling
+//! thread. A fixed number of blocks circulate through the pipeline, and are reused, so the
+//! memory it takes is bounded, however large the catalog is.
+//!
+//! Two formats are read:
+//!
+//! - delimited text (e.g. CSV), with a header line naming the columns, and optional comment
+//!   lines starting with `#`. Fields are not quoted, and empty fields, `null` and `NaN` are
+//!   missing values;
+//! - FITS binary tables (the first `BINTABLE` extension of the file), with scalar columns of
+//!   types `D`, `E`, `K`, `J` or `I`, scaled by `TSCALn` and `TZEROn`. NaN values are missing.
+//!
+//! Missing proper motions, parallaxes or radial velocities are taken as zero, while a missing
+//! R.A. or declination is an error.
+//!
+//! ```no_run
+//! use astrokits::catalog::{CatalogReader, CatalogSpec};
+//! use astrokits::sky::{Accuracy, Frame, Observer, System, Time, Timescale};
+//!
+//! let time = Time::new(Timescale::Utc, 2460000.5, 37, 0.1).unwrap();
+//! let frame = Frame::new(Accuracy::Reduced, &Observer::geocenter(), &time, 0.0, 0.0).unwrap();
+//!
+//! let reader = CatalogReader::open("gaia-dr3.fits", &CatalogSpec::gaia()).unwrap();
+//! let n = reader.sky_pos_stream(&frame, System::Cirs, 0, 16, |first, stars, pos| {
+//!     // rows first..first + stars.len() of the catalog
+//! }).unwrap();
+//! ```
+
+use std::collections::BTreeMap;
+use std::fmt;
+use std::fs::File;
+use std::io::{self, Read, Seek, SeekFrom};
+use std::path::Path;
+use std::sync::mpsc::sync_channel;
+use std::sync::{Arc, Mutex};
+use std::thread;
+
+use crate::sky::{self, Frame, SkyPos, StarColumns, System};
+
+// [bytes] Size of the blocks read from catalog files
+const BLOCK_SIZE: usize = 1 << 22;
+
+// [bytes] Size of FITS header and data blocks, and of header cards
+const FITS_BLOCK: usize = 2880;
+const FITS_CARD: usize = 80;
+
+// [day] TT-based Julian date of the epoch J2000
+const JD_J2000: f64 = 2451545.0;
+
+/// Errors from reading catalogs.
+#[derive(Debug)]
+pub enum CatalogError {
+    /// Reading the catalog file failed.
+    Io(io::Error),
+    /// The file is not a valid catalog of the expected layout.
+    Format(String),
+    /// The astrometry failed.
+    Novas(sky::Error),
+}
+
+impl fmt::Display for CatalogError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            CatalogError::Io(e) => write!(f, "catalog I/O error: {}", e),
+            CatalogError::Format(msg) => write!(f, "invalid catalog: {}", msg),
+            CatalogError::Novas(e) => write!(f, "{}", e),
+        }
+    }
+}
+
+impl std::error::Error for CatalogError {}
+
+impl From<io::Error> for CatalogError {
+    fn from(e: io::Error) -> Self {
+        CatalogError::Io(e)
+    }
+}
+
+impl From<sky::Error> for CatalogError {
+    fn from(e: sky::Error) -> Self {
+        CatalogError::Novas(e)
+    }
+}
+
+pub type Result<T> = std::result::Result<T, CatalogError>;
+
+/// Units of the right ascensions in a catalog.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum RaUnit {
+    Degrees,
+    Hours,
+}
+
+/// The columns of a catalog holding the astrometric quantities, with the units of
+/// [`StarColumns`] (except for the R.A.), and the epoch of the positions.
+#[derive(Clone, Debug, PartialEq)]
+pub struct CatalogSpec {
+    /// Name of the R.A. column.
+    pub ra: String,
+    /// Name of the declination column [deg].
+    pub dec: String,
+    /// Name of the column of proper motions in R.A. (times cos(dec)) [mas/yr], if any.
+    pub pm_ra: Option<String>,
+    /// Name of the column of proper motions in declination [mas/yr], if any.
+    pub pm_dec: Option<String>,
+    /// Name of the parallax column [mas], if any.
+    pub parallax: Option<String>,
+    /// Name of the radial velocity column [km/s], if any.
+    pub rv: Option<String>,
+    /// Units of the R.A. column.
+    pub ra_unit: RaUnit,
+    /// Epoch of the positions, as a Julian year (e.g. 2016.0), or a TT-based Julian date.
+    pub epoch: f64,
+    /// Field delimiter of text catalogs.
+    pub delimiter: u8,
+}
+
+impl CatalogSpec {
+    /// A comma-separated catalog of J2000 positions with R.A. in degrees, and without motions.
+    pub fn new(ra: &str, dec: &str) -> CatalogSpec {
+        CatalogSpec {
+            ra: ra.into(),
+            dec: dec.into(),
+            pm_ra: None,
+            pm_dec: None,
+            parallax: None,
+            rv: None,
+            ra_unit: RaUnit::Degrees,
+            epoch: JD_J2000,
+            delimiter: b',',
+        }
+    }
+
+    /// The columns of the Gaia DR3 `gaia_source` table, at epoch J2016.0.
+    pub fn gaia() -> CatalogSpec {
+        CatalogSpec {
+            pm_ra: Some("pmra".into()),
+            pm_dec: Some("pmdec".into()),
+            parallax: Some("parallax".into()),
+            rv: Some("radial_velocity".into()),
+            epoch: 2016.0,
+            ..CatalogSpec::new("ra", "dec")
+        }
+    }
+
+    // The column names, in the order of the StarColumns fields
+    fn names(&self) -> [Option<&str>; 6] {
+        [Some(self.ra.as_str()), Some(self.dec.as_str()), self.pm_ra.as_deref(), self.pm_dec.as_deref(),
+            self.parallax.as_deref(), self.rv.as_deref()]
+    }
+}
+
+// A scalar column of a FITS binary table
+#[derive(Clone, Copy, Debug)]
+struct FitsField {
+    offset: usize,
+    kind: u8,
+    scale: f64,
+    zero: f64,
+}
+
+impl FitsField {
+    fn value(&self, row: &[u8]) -> f64 {
+        let b = &row[self.offset..];
+        let raw = match self.kind {
+            b'D' => f64::from_be_bytes(b[..8].try_into().unwrap()),
+            b'E' => f32::from_be_bytes(b[..4].try_into().unwrap()) as f64,
+            b'K' => i64::from_be_bytes(b[..8].try_into().unwrap()) as f64,
+            b'J' => i32::from_be_bytes(b[..4].try_into().unwrap()) as f64,
+            _ => i16::from_be_bytes(b[..2].try_into().unwrap()) as f64,
+        };
+        self.zero + self.scale * raw
+    }
+}
+
+// How the rows of a catalog are laid out
+#[derive(Clone, Debug)]
+enum Layout {
+    // The StarColumns field (if any) of each delimited field
+    Text { fields: Vec<Option<usize>>, delimiter: u8 },
+    // Fixed-size rows, and the StarColumns fields, if in the table
+    Fits { row: usize, fields: [Option<FitsField>; 6] },
+}
+
+// Parses blocks of whole rows into star columns at epoch J2000, independently of the file
+#[derive(Clone, Debug)]
+struct Parser {
+    layout: Layout,
+    // [h/unit] Factor converting the R.A. column to hours
+    ra_scale: f64,
+    epoch: f64,
+}
+
+impl Parser {
+    fn parse(&self, bytes: &[u8], out: &mut StarColumns) -> Result<()> {
+        out.clear();
+
+        match &self.layout {
+            Layout::Text { fields, delimiter } => {
+                for line in bytes.split(|&b| b == b'\n') {
+                    let line = line.strip_suffix(b"\r").unwrap_or(line);
+                    if line.is_empty() || line[0] == b'#' {
+                        continue;
+                    }
+
+                    let mut v = [f64::NAN; 6];
+                    for (field, slot) in line.split(|b| b == delimiter).zip(fields.iter()) {
+                        if let Some(k) = *slot {
+                            v[k] = text_value(field);
+                        }
+                    }
+                    self.push(out, v, || String::from_utf8_lossy(line).into_owned())?;
+                }
+            }
+            Layout::Fits { row, fields } => {
+                for r in bytes.chunks_exact(*row) {
+                    let v = fields.map(|f| f.map_or(f64::NAN, |f| f.value(r)));
+                    self.push(out, v, || format!("{:?}", v))?;
+                }
+            }
+        }
+
+        if self.epoch != JD_J2000 && self.epoch != 2000.0 {
+            out.propagate(self.epoch, JD_J2000)?;
+        }
+        Ok(())
+    }
+
+    // Appends a row, with missing values of the optional columns as zero
+    fn push(&self, out: &mut StarColumns, v: [f64; 6], row: impl Fn() -> String) -> Result<()> {
+        if v[0].is_nan() || v[1].is_nan() {
+            return Err(CatalogError::Format(format!("missing R.A. or declination in row: {}", row())));
+        }
+        let z = |x: f64| if x.is_nan() { 0.0 } else { x };
+        out.push(v[0] * self.ra_scale, v[1], z(v[2]), z(v[3]), z(v[4]), z(v[5]));
+        Ok(())
+    }
+}
+
+// The value of a text field, or NaN if it is missing or not a number
+fn text_value(field: &[u8]) -> f64 {
+    std::str::from_utf8(field).ok().and_then(|s| s.trim().parse().ok()).unwrap_or(f64::NAN)
+}
+
+// The value of a FITS header card, without quotes and comments, if it is the keyword
+fn card_value<'a>(card: &'a str, key: &str) -> Option<&'a str> {
+    let (k, v) = card.split_at_checked(8)?;
+    if k.trim_end() != key || !v.starts_with("= ") {
+        return None;
+    }
+    let v = v[2..].trim_start();
+    Some(match v.strip_prefix('\'') {
+        Some(s) => s.split('\'').next().unwrap_or("").trim_end(),
+        None => v.split('/').next().unwrap_or("").trim(),
+    })
+}
+
+// The cards of the next FITS header, up to the END card
+fn read_fits_header(file: &mut File) -> Result<Vec<String>> {
+    let mut cards = Vec::new();
+    let mut block = [0u8; FITS_BLOCK];
+
+    loop {
+        file.read_exact(&mut block)?;
+        for card in block.chunks_exact(FITS_CARD) {
+            let card = String::from_utf8_lossy(card).into_owned();
+            if card.trim_end() == "END" {
+                return Ok(cards);
+            }
+            cards.push(card);
+        }
+    }
+}
+
+/// A catalog file, read in blocks of rows.
+pub struct CatalogReader {
+    file: File,
+    parser: Parser,
+    // Text: the partial row after the last block. FITS: unused.
+    carry: Vec<u8>,
+    // FITS: rows not read yet
+    rows: u64,
+    // The block of the serial reads
+    block: Vec<u8>,
+}
+
+impl CatalogReader {
+    /// Opens a catalog file, which is read as a FITS binary table if it starts with a FITS header,
+    /// or else as delimited text, with the columns given in `spec`.
+    pub fn open<P: AsRef<Path>>(path: P, spec: &CatalogSpec) -> Result<CatalogReader> {
+        let mut file = File::open(path)?;
+        let mut magic = [0u8; 9];
+        let n = (&mut file).take(magic.len() as u64).read(&mut magic)?;
+        file.seek(SeekFrom::Start(0))?;
+
+        let ra_scale = if spec.ra_unit == RaUnit::Degrees { 1.0 / 15.0 } else { 1.0 };
+        let mut reader = CatalogReader {
+            file,
+            parser: Parser { layout: Layout::Text { fields: Vec::new(), delimiter: spec.delimiter }, ra_scale,
+                epoch: spec.epoch },
+            carry: Vec::new(),
+            rows: 0,
+            block: Vec::new(),
+        };
+
+        reader.parser.layout = if n == magic.len() && &magic == b"SIMPLE  =" {
+            reader.open_fits(spec)?
+        } else {
+            reader.open_text(spec)?
+        };
+        Ok(reader)
+    }
+
+    // Reads the header line, mapping the named columns to the fields
+    fn open_text(&mut self, spec: &CatalogSpec) -> Result<Layout> {
+        let header = loop {
+            if let Some(k) = self.carry.iter().position(|&b| b == b'\n') {
+                let line: Vec<u8> = self.carry.drain(..=k).collect();
+                if line[0] == b'#' {
+                    continue;
+                }
+                break line;
+            }
+            if (&mut self.file).take(BLOCK_SIZE as u64).read_to_end(&mut self.carry)? == 0 {
+                return Err(CatalogError::Format("no header line".into()));
+            }
+        };
+
+        let header = String::from_utf8_lossy(&header);
+        let names: Vec<&str> = header.trim_end().split(spec.delimiter as char).map(str::trim).collect();
+        let mut fields = vec![None; names.len()];
+
+        for (k, name) in spec.names().into_iter().enumerate() {
+            let Some(name) = name else { continue };
+            let i = names.iter().position(|n| n.eq_ignore_ascii_case(name))
+                .ok_or_else(|| CatalogError::Format(format!("no column '{}'", name)))?;
+            fields[i] = Some(k);
+        }
+
+        Ok(Layout::Text { fields, delimiter: spec.delimiter })
+    }
+
+    // Skips to the first binary table, mapping the named columns to the fields of its rows
+    fn open_fits(&mut self, spec: &CatalogSpec) -> Result<Layout> {
+        let bad = |msg: String| CatalogError::Format(msg);
+
+        loop {
+            let cards = read_fits_header(&mut self.file)?;
+            let value = |key: &str| cards.iter().find_map(|c| card_value(c, key));
+            let int = |key: &str| value(key).and_then(|v| v.parse::<u64>().ok());
+            let naxis = int("NAXIS").unwrap_or(0);
+
+            if value("XTENSION") == Some("BINTABLE") {
+                let row = int("NAXIS1").ok_or_else(|| bad("no NAXIS1 in binary table".into()))? as usize;
+                self.rows = int("NAXIS2").unwrap_or(0);
+
+                let mut offsets = BTreeMap::new();
+                let mut offset = 0;
+                for i in 1..=int("TFIELDS").unwrap_or(0) {
+                    let form = value(&format!("TFORM{}", i)).unwrap_or("");
+                    let digits = form.bytes().take_while(u8::is_ascii_digit).count();
+                    let repeat: usize = form[..digits].parse().unwrap_or(1);
+                    let kind = form.as_bytes().get(digits).copied().unwrap_or(b'?');
+                    let size = match kind {
+                        b'L' | b'B' | b'A' => repeat,
+                        b'X' => repeat.div_ceil(8),
+                        b'I' => 2 * repeat,
+                        b'J' | b'E' => 4 * repeat,
+                        b'K' | b'D' | b'C' | b'P' => 8 * repeat,
+                        b'M' | b'Q' => 16 * repeat,
+                        _ => return Err(bad(format!("unsupported TFORM{} '{}'", i, form))),
+                    };
+
+                    if let Some(name) = value(&format!("TTYPE{}", i)) {
+                        let f = |key: &str| value(&format!("{}{}", key, i)).and_then(|v| v.parse::<f64>().ok());
+                        let field = FitsField { offset, kind, scale: f("TSCAL").unwrap_or(1.0), zero: f("TZERO").unwrap_or(0.0) };
+                        offsets.insert(name.to_ascii_lowercase(), (field, repeat));
+                    }
+                    offset += size;
+                }
+
+                if offset != row {
+                    return Err(bad(format!("columns take {} bytes of {}-byte rows", offset, row)));
+                }
+
+                let mut fields = [None; 6];
+                for (k, name) in spec.names().into_iter().enumerate() {
+                    let Some(name) = name else { continue };
+                    let (field, repeat) = *offsets.get(&name.to_ascii_lowercase())
+                        .ok_or_else(|| bad(format!("no column '{}'", name)))?;
+                    if repeat != 1 || !b"DEKJI".contains(&field.kind) {
+                        return Err(bad(format!("column '{}' is not a numeric scalar", name)));
+                    }
+                    fields[k] = Some(field);
+                }
+
+                return Ok(Layout::Fits { row, fields });
+            }
+
+            // Skip the data of other HDUs
+            let bitpix = value("BITPIX").and_then(|v| v.parse::<i64>().ok()).unwrap_or(8).unsigned_abs();
+            let axes: u64 = if naxis > 0 { (1..=naxis).map(|i| int(&format!("NAXIS{}", i)).unwrap_or(0)).product() } else { 0 };
+            let bytes = bitpix / 8 * int("GCOUNT").unwrap_or(1) * (int("PCOUNT").unwrap_or(0) + axes);
+            self.file.seek(SeekFrom::Current(bytes.div_ceil(FITS_BLOCK as u64) as i64 * FITS_BLOCK as i64))?;
+        }
+    }
+
+    // Reads the next block of whole rows into `buf`, returning false at the end of the file
+    fn read_block(&mut self, buf: &mut Vec<u8>) -> Result<bool> {
+        buf.clear();
+
+        if let Layout::Fits { row, .. } = self.parser.layout {
+            let n = self.rows.min((BLOCK_SIZE / row).max(1) as u64);
+            self.rows -= n;
+            buf.resize(n as usize * row, 0);
+            self.file.read_exact(buf)?;
+            return Ok(n > 0);
+        }
+
+        buf.append(&mut self.carry);
+        loop {
+            let start = buf.len();
+            if (&mut self.file).take(BLOCK_SIZE as u64).read_to_end(buf)? == 0 {
+                return Ok(!buf.is_empty());
+            }
+            // The partial row after the last newline goes with the next block.
+            if let Some(k) = buf[start..].iter().rposition(|&b| b == b'\n') {
+                self.carry.extend_from_slice(&buf[start + k + 1..]);
+                buf.truncate(start + k + 1);
+                return Ok(true);
+            }
+        }
+    }
+
+    /// Reads the next block of rows into `out`, replacing its contents, with the positions moved
+    /// to the epoch J2000. Returns the number of rows read, which is 0 at the end of the catalog.
+    pub fn read_chunk(&mut self, out: &mut StarColumns) -> Result<usize> {
+        let mut block = std::mem::take(&mut self.block);
+        let more = self.read_block(&mut block);
+        let parsed = match more {
+            Ok(true) => self.parser.parse(&block, out),
+            Ok(false) => {
+                out.clear();
+                Ok(())
+            }
+            Err(e) => Err(e),
+        };
+        self.block = block;
+        parsed.map(|_| out.len())
+    }
+
+    /// Calculates the apparent positions of all stars in the catalog, in `frame`, passing them to
+    /// `sink` block by block, in file order, with the index of the first row of the block, the
+    /// stars (at epoch J2000) and their positions. The file is read on one thread, while the
+    /// blocks are parsed, and their positions calculated, on `threads` others (or as many as there
+    /// are cores, if 0). At most `depth` blocks (of up to a few MB each) are in the pipeline at a
+    /// time, which should be more than `threads` to keep them all busy.
+    ///
+    /// Returns the number of stars in the catalog.
+    pub fn sky_pos_stream<F>(mut self, frame: &Frame, sys: System, threads: usize, depth: usize, mut sink: F)
+        -> Result<usize>
+    where
+        F: FnMut(usize, &StarColumns, &[SkyPos]),
+    {
+        #[derive(Default)]
+        struct Block {
+            seq: usize,
+            bytes: Vec<u8>,
+            stars: StarColumns,
+            pos: Vec<SkyPos>,
+        }
+
+        let threads = if threads > 0 { threads } else { thread::available_parallelism().map_or(1, |n| n.get()) };
+        let depth = depth.max(1);
+        let parser = self.parser.clone();
+
+        // Free blocks go to the reader, read blocks to the workers, and finished blocks to the sink.
+        let (free_tx, free_rx) = sync_channel::<Block>(depth);
+        let (read_tx, read_rx) = sync_channel::<Block>(depth);
+        let (done_tx, done_rx) = sync_channel::<Result<Block>>(depth);
+        let read_rx = Arc::new(Mutex::new(read_rx));
+
+        for _ in 0..depth {
+            free_tx.send(Block::default()).unwrap();
+        }
+
+        thread::scope(|s| {
+            let reader = s.spawn(move || -> Result<()> {
+                for seq in 0.. {
+                    let Ok(mut block) = free_rx.recv() else { break };
+                    if !self.read_block(&mut block.bytes)? {
+                        break;
+                    }
+                    block.seq = seq;
+                    if read_tx.send(block).is_err() {
+                        break;
+                    }
+                }
+                Ok(())
+            });
+
+            for _ in 0..threads {
+                let (read_rx, done_tx, parser) = (Arc::clone(&read_rx), done_tx.clone(), &parser);
+                s.spawn(move || loop {
+                    let next = read_rx.lock().unwrap_or_else(|e| e.into_inner()).recv();
+                    let Ok(mut block) = next else { return };
+
+                    let done = parser.parse(&block.bytes, &mut block.stars).and_then(|_| {
+                        block.pos.resize(block.stars.len(), SkyPos::default());
+                        Ok(frame.columns_pos_into(&block.stars, sys, &mut block.pos)?)
+                    });
+
+                    if done_tx.send(done.map(|_| block)).is_err() {
+                        return;
+                    }
+                });
+            }
+            drop((done_tx, read_rx));
+
+            // Blocks may finish out of order, so they are held until the preceding ones are done.
+            let mut pending = BTreeMap::new();
+            let (mut next, mut rows) = (0, 0);
+            let mut result = Ok(());
+
+            for done in done_rx.iter() {
+                match done {
+                    Ok(block) => {
+                        pending.insert(block.seq, block);
+                        while let Some(block) = pending.remove(&next) {
+                            sink(rows, &block.stars, &block.pos);
+                            rows += block.stars.len();
+                            next += 1;
+                            let _ = free_tx.send(block);
+                        }
+                    }
+                    Err(e) => {
+                        result = Err(e);
+                        break;
+                    }
+                }
+            }
+
+            // Stops the reader and workers, if there was an error.
+            drop((done_rx, free_tx));
+            result.and(reader.join().unwrap()).map(|_| rows)
+        })
+    }
+}
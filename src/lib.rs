@@ -11,4 +11,10 @@ pub mod calceph {
 #[cfg(feature = "novas")]
 pub mod supernvas {
     pub use supernovas_sys::*;
-}
\ No newline at end of file
+}
+
+#[cfg(feature = "novas")]
+pub mod sky;
+
+#[cfg(feature = "novas")]
+pub mod catalog;
@@ -0,0 +1,1959 @@
+//! Safe, batch-oriented frontend to the SuperNOVAS astrometry.
+//!
+//! The types here are thin, layout-compatible wrappers around the SuperNOVAS structures, so
+//! slices of them are passed to the C library as they are, without copying or allocating on the
+//! heap. Batch methods take output slices from the caller, and have `par_` counterparts running
+//! on the Rayon pool when the `rayon` feature is enabled.
+//!
+//! SuperNOVAS calculations are reentrant, but the ephemeris providers are process-wide settings.
+//! Calculations therefore share a read lock, once per call (not per element), while the
+//! [`Ephemeris`] setup functions, which swap providers, take it exclusively.
+
+use std::collections::VecDeque;
+use std::ffi::CString;
+use std::fmt;
+use std::mem::{self, MaybeUninit};
+use std::os::raw::{c_char, c_int, c_long, c_void};
+use std::sync::{Arc, Condvar, Mutex, MutexGuard, RwLock, RwLockReadGuard, RwLockWriteGuard};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+use supernovas_sys as sn;
+
+#[cfg(feature = "rayon")]
+use rayon::prelude::*;
+
+// Elements per Rayon task in the parallel batch methods
+#[cfg(feature = "rayon")]
+const PAR_CHUNK: usize = 256;
+
+// Pixels per Rayon task in the parallel all-sky mappings, which are much cheaper per element
+#[cfg(feature = "rayon")]
+const PIXEL_CHUNK: usize = 16384;
+
+// Events per Rayon task in the parallel barycentering, which is cheaper still per element
+#[cfg(feature = "rayon")]
+const EVENT_CHUNK: usize = 65536;
+
+// Guards the process-wide ephemeris providers against being swapped mid-calculation
+static PROVIDERS: RwLock<()> = RwLock::new(());
+
+fn shared() -> RwLockReadGuard<'static, ()> {
+    PROVIDERS.read().unwrap_or_else(|e| e.into_inner())
+}
+
+fn exclusive() -> RwLockWriteGuard<'static, ()> {
+    PROVIDERS.write().unwrap_or_else(|e| e.into_inner())
+}
+
+/// Errors returned by the safe frontend.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Error {
+    /// A SuperNOVAS function returned a non-zero status.
+    Novas { func: &'static str, code: i32 },
+    /// An output slice does not match the length of the input.
+    Length { expected: usize, found: usize },
+    /// The file name at `index` in a list contains a NUL byte, so it cannot be passed to C.
+    Nul { index: usize },
+}
+
+impl fmt::Display for Error {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            Error::Novas { func, code } => write!(f, "{}() failed with error code {}", func, code),
+            Error::Length { expected, found } => {
+                write!(f, "output length mismatch: expected {}, found {}", expected, found)
+            }
+            Error::Nul { index } => write!(f, "name [{}] contains a NUL byte", index),
+        }
+    }
+}
+
+impl std::error::Error for Error {}
+
+pub type Result<T> = std::result::Result<T, Error>;
+
+fn check(func: &'static str, code: i32) -> Result<()> {
+    if code == 0 { Ok(()) } else { Err(Error::Novas { func, code }) }
+}
+
+fn check_len(expected: usize, found: usize) -> Result<()> {
+    if expected == found { Ok(()) } else { Err(Error::Length { expected, found }) }
+}
+
+// C strings for a list of file names, or an error for the first name containing a NUL byte
+fn c_strings<S: AsRef<str>>(names: &[S]) -> Result<Vec<CString>> {
+    names.iter().enumerate().map(|(index, s)| CString::new(s.as_ref()).map_err(|_| Error::Nul { index })).collect()
+}
+
+// A zero-initialized C structure, which is a valid empty state for all SuperNOVAS types
+fn zeroed<T>() -> T {
+    unsafe { MaybeUninit::<T>::zeroed().assume_init() }
+}
+
+// A 0-terminated copy of a name in a stack buffer, truncated to fit if necessary
+fn c_name<const N: usize>(s: &str) -> [c_char; N] {
+    let mut buf = [0 as c_char; N];
+    for (d, &b) in buf[..N - 1].iter_mut().zip(s.as_bytes().iter().take_while(|&&b| b != 0)) {
+        *d = b as c_char;
+    }
+    buf
+}
+
+/// Accuracy of the calculations.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Accuracy {
+    /// Sub-&mu;as accuracy, which requires a high-precision planet provider.
+    Full,
+    /// Accuracy at the mas level.
+    Reduced,
+}
+
+impl Accuracy {
+    fn raw(self) -> sn::novas_accuracy {
+        match self {
+            Accuracy::Full => sn::novas_accuracy_NOVAS_FULL_ACCURACY,
+            Accuracy::Reduced => sn::novas_accuracy_NOVAS_REDUCED_ACCURACY,
+        }
+    }
+}
+
+/// Astronomical timescales.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Timescale {
+    Tcb,
+    Tdb,
+    Tcg,
+    Tt,
+    Tai,
+    Gps,
+    Utc,
+    Ut1,
+}
+
+impl Timescale {
+    fn raw(self) -> sn::novas_timescale {
+        match self {
+            Timescale::Tcb => sn::novas_timescale_NOVAS_TCB,
+            Timescale::Tdb => sn::novas_timescale_NOVAS_TDB,
+            Timescale::Tcg => sn::novas_timescale_NOVAS_TCG,
+            Timescale::Tt => sn::novas_timescale_NOVAS_TT,
+            Timescale::Tai => sn::novas_timescale_NOVAS_TAI,
+            Timescale::Gps => sn::novas_timescale_NOVAS_GPS,
+            Timescale::Utc => sn::novas_timescale_NOVAS_UTC,
+            Timescale::Ut1 => sn::novas_timescale_NOVAS_UT1,
+        }
+    }
+}
+
+/// Coordinate reference systems for the output positions.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum System {
+    Gcrs,
+    Tod,
+    Cirs,
+    Icrs,
+    J2000,
+    Mod,
+    Tirs,
+    Itrs,
+}
+
+impl System {
+    fn raw(self) -> sn::novas_reference_system {
+        match self {
+            System::Gcrs => sn::novas_reference_system_NOVAS_GCRS,
+            System::Tod => sn::novas_reference_system_NOVAS_TOD,
+            System::Cirs => sn::novas_reference_system_NOVAS_CIRS,
+            System::Icrs => sn::novas_reference_system_NOVAS_ICRS,
+            System::J2000 => sn::novas_reference_system_NOVAS_J2000,
+            System::Mod => sn::novas_reference_system_NOVAS_MOD,
+            System::Tirs => sn::novas_reference_system_NOVAS_TIRS,
+            System::Itrs => sn::novas_reference_system_NOVAS_ITRS,
+        }
+    }
+}
+
+/// Atmospheric refraction models for horizontal coordinates.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Refraction {
+    /// Unrefracted (astrometric) elevations.
+    None,
+    Standard,
+    Optical,
+    Radio,
+    /// Wavelength-dependent model, at the given wavelength [&mu;m].
+    Wave(f64),
+}
+
+impl Refraction {
+    fn raw(self) -> (sn::RefractionModel, f64) {
+        match self {
+            Refraction::None => (None, 0.0),
+            Refraction::Standard => (Some(sn::novas_standard_refraction), 0.0),
+            Refraction::Optical => (Some(sn::novas_optical_refraction), 0.0),
+            Refraction::Radio => (Some(sn::novas_radio_refraction), 0.0),
+            Refraction::Wave(microns) => (Some(sn::novas_wave_refraction), microns),
+        }
+    }
+}
+
+/// Major solar-system bodies.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Planet {
+    Ssb,
+    Mercury,
+    Venus,
+    Earth,
+    Mars,
+    Jupiter,
+    Saturn,
+    Uranus,
+    Neptune,
+    Pluto,
+    Sun,
+    Moon,
+    Emb,
+    PlutoBarycenter,
+}
+
+impl Planet {
+    fn raw(self) -> sn::novas_planet {
+        match self {
+            Planet::Ssb => sn::novas_planet_NOVAS_SSB,
+            Planet::Mercury => sn::novas_planet_NOVAS_MERCURY,
+            Planet::Venus => sn::novas_planet_NOVAS_VENUS,
+            Planet::Earth => sn::novas_planet_NOVAS_EARTH,
+            Planet::Mars => sn::novas_planet_NOVAS_MARS,
+            Planet::Jupiter => sn::novas_planet_NOVAS_JUPITER,
+            Planet::Saturn => sn::novas_planet_NOVAS_SATURN,
+            Planet::Uranus => sn::novas_planet_NOVAS_URANUS,
+            Planet::Neptune => sn::novas_planet_NOVAS_NEPTUNE,
+            Planet::Pluto => sn::novas_planet_NOVAS_PLUTO,
+            Planet::Sun => sn::novas_planet_NOVAS_SUN,
+            Planet::Moon => sn::novas_planet_NOVAS_MOON,
+            Planet::Emb => sn::novas_planet_NOVAS_EMB,
+            Planet::PlutoBarycenter => sn::novas_planet_NOVAS_PLUTO_BARYCENTER,
+        }
+    }
+}
+
+/// Origin of ephemeris positions.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Origin {
+    Barycenter,
+    Heliocenter,
+}
+
+impl Origin {
+    fn raw(self) -> sn::novas_origin {
+        match self {
+            Origin::Barycenter => sn::novas_origin_NOVAS_BARYCENTER,
+            Origin::Heliocenter => sn::novas_origin_NOVAS_HELIOCENTER,
+        }
+    }
+}
+
+/// An astronomical time instant.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Time(sn::novas_timespec);
+
+impl Time {
+    /// Time from a Julian date in the given timescale. `leap` is the number of leap seconds
+    /// (TAI - UTC) and `dut1` [s] is UT1 - UTC.
+    pub fn new(scale: Timescale, jd: f64, leap: i32, dut1: f64) -> Result<Time> {
+        let mut t = zeroed();
+        check("novas_set_time", unsafe { sn::novas_set_time(scale.raw(), jd, leap, dut1, &mut t) })?;
+        Ok(Time(t))
+    }
+
+    /// Time from a Julian date split into integer and fractional days, for full precision.
+    pub fn split(scale: Timescale, ijd: i64, fjd: f64, leap: i32, dut1: f64) -> Result<Time> {
+        let mut t = zeroed();
+        check("novas_set_split_time", unsafe {
+            sn::novas_set_split_time(scale.raw(), ijd as _, fjd, leap, dut1, &mut t)
+        })?;
+        Ok(Time(t))
+    }
+
+    /// Time from a UNIX timestamp.
+    pub fn unix(secs: i64, nanos: i64, leap: i32, dut1: f64) -> Result<Time> {
+        let mut t = zeroed();
+        check("novas_set_unix_time", unsafe { sn::novas_set_unix_time(secs as _, nanos as _, leap, dut1, &mut t) })?;
+        Ok(Time(t))
+    }
+
+    /// The Julian date in the given timescale.
+    pub fn jd(&self, scale: Timescale) -> f64 {
+        unsafe { sn::novas_get_time(&self.0, scale.raw()) }
+    }
+
+    /// The time, offset by `seconds`.
+    pub fn offset(&self, seconds: f64) -> Result<Time> {
+        let mut t = zeroed();
+        check("novas_offset_time", unsafe { sn::novas_offset_time(&self.0, seconds, &mut t) })?;
+        Ok(Time(t))
+    }
+
+    pub fn as_raw(&self) -> &sn::novas_timespec {
+        &self.0
+    }
+
+    /// [s] The time elapsed since `other` (negative if `other` is later).
+    pub fn since(&self, other: &Time) -> f64 {
+        unsafe { sn::novas_diff_time(&self.0, &other.0) }
+    }
+
+    // Whether frames for the two times are the same
+    fn same_epoch(&self, other: &Time) -> bool {
+        self.0.ijd_tt == other.0.ijd_tt && self.0.fjd_tt == other.0.fjd_tt
+            && self.0.ut1_to_tt == other.0.ut1_to_tt && self.0.tt2tdb == other.0.tt2tdb
+    }
+}
+
+/// An observer location.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Observer(sn::observer);
+
+impl Observer {
+    /// A geocentric observer.
+    pub fn geocenter() -> Observer {
+        let mut obs = zeroed();
+        unsafe { sn::make_observer_at_geocenter(&mut obs) };
+        Observer(obs)
+    }
+
+    /// An observer on the Earth's surface, at the given geodetic `lat` [deg], `lon` [deg] and
+    /// `height` [m], with ambient `temp` [C] and `pressure` [mbar].
+    pub fn on_surface(lat: f64, lon: f64, height: f64, temp: f64, pressure: f64) -> Result<Observer> {
+        let mut obs = zeroed();
+        check("make_observer_on_surface", unsafe {
+            sn::make_observer_on_surface(lat, lon, height, temp, pressure, &mut obs)
+        })?;
+        Ok(Observer(obs))
+    }
+
+    /// An observer in Earth orbit, at the geocentric position `pos` [km] and velocity `vel` [km/s].
+    pub fn in_space(pos: &[f64; 3], vel: &[f64; 3]) -> Result<Observer> {
+        let mut obs = zeroed();
+        check("make_observer_in_space", unsafe {
+            sn::make_observer_in_space(pos.as_ptr(), vel.as_ptr(), &mut obs)
+        })?;
+        Ok(Observer(obs))
+    }
+
+    /// An observer anywhere in the Solar System, at the barycentric ICRS position `pos` [AU] and
+    /// velocity `vel` [AU/day].
+    pub fn solar_system(pos: &[f64; 3], vel: &[f64; 3]) -> Result<Observer> {
+        let mut obs = zeroed();
+        check("make_solar_system_observer", unsafe {
+            sn::make_solar_system_observer(pos.as_ptr(), vel.as_ptr(), &mut obs)
+        })?;
+        Ok(Observer(obs))
+    }
+
+    pub fn as_raw(&self) -> &sn::observer {
+        &self.0
+    }
+}
+
+/// Catalog astrometric data for a sidereal source, in ICRS.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Star(sn::cat_entry);
+
+impl Star {
+    /// A star at `ra` [h], `dec` [deg] with proper motions `pm_ra`, `pm_dec` [mas/yr], `parallax`
+    /// [mas] and radial velocity `rv` [km/s]. The name is truncated to the C library's limit.
+    pub fn new(name: &str, ra: f64, dec: f64, pm_ra: f64, pm_dec: f64, parallax: f64, rv: f64) -> Result<Star> {
+        let cname = c_name::<{ sn::SIZE_OF_OBJ_NAME as usize }>(name);
+        let catalog = [0 as c_char; 1];
+        let mut star = zeroed();
+        check("make_cat_entry", unsafe {
+            sn::make_cat_entry(cname.as_ptr(), catalog.as_ptr(), 0, ra, dec, pm_ra, pm_dec, parallax, rv, &mut star)
+        })?;
+        Ok(Star(star))
+    }
+
+    pub fn as_raw(&self) -> &sn::cat_entry {
+        &self.0
+    }
+}
+
+/// Catalog stars in columns (structure-of-arrays form), without names, for the columnar catalog
+/// functions of SuperNOVAS. The columns hold the same quantities, in the same units, as
+/// [`Star::new()`], and they must all have the same length.
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct StarColumns {
+    /// [h] Right ascensions.
+    pub ra: Vec<f64>,
+    /// [deg] Declinations.
+    pub dec: Vec<f64>,
+    /// [mas/yr] Proper motions in right ascension (times cos(dec)).
+    pub pm_ra: Vec<f64>,
+    /// [mas/yr] Proper motions in declination.
+    pub pm_dec: Vec<f64>,
+    /// [mas] Parallaxes.
+    pub parallax: Vec<f64>,
+    /// [km/s] Radial velocities.
+    pub rv: Vec<f64>,
+}
+
+impl StarColumns {
+    /// Empty columns, with room for `n` stars.
+    pub fn with_capacity(n: usize) -> StarColumns {
+        StarColumns {
+            ra: Vec::with_capacity(n),
+            dec: Vec::with_capacity(n),
+            pm_ra: Vec::with_capacity(n),
+            pm_dec: Vec::with_capacity(n),
+            parallax: Vec::with_capacity(n),
+            rv: Vec::with_capacity(n),
+        }
+    }
+
+    /// The number of stars.
+    pub fn len(&self) -> usize {
+        self.ra.len()
+    }
+
+    /// Whether there are no stars.
+    pub fn is_empty(&self) -> bool {
+        self.ra.is_empty()
+    }
+
+    /// Removes all stars, keeping the allocated room.
+    pub fn clear(&mut self) {
+        for col in self.columns_mut() {
+            col.clear();
+        }
+    }
+
+    /// Appends a star, with the quantities of [`Star::new()`].
+    pub fn push(&mut self, ra: f64, dec: f64, pm_ra: f64, pm_dec: f64, parallax: f64, rv: f64) {
+        for (col, v) in self.columns_mut().into_iter().zip([ra, dec, pm_ra, pm_dec, parallax, rv]) {
+            col.push(v);
+        }
+    }
+
+    fn columns_mut(&mut self) -> [&mut Vec<f64>; 6] {
+        [&mut self.ra, &mut self.dec, &mut self.pm_ra, &mut self.pm_dec, &mut self.parallax, &mut self.rv]
+    }
+
+    fn check(&self) -> Result<()> {
+        for col in [&self.dec, &self.pm_ra, &self.pm_dec, &self.parallax, &self.rv] {
+            check_len(self.ra.len(), col.len())?;
+        }
+        Ok(())
+    }
+
+    // The read-only C view of rows `from` to `from + n`, for inputs only (the C struct has no
+    // const pointers)
+    fn raw(&self, from: usize) -> sn::novas_cat_columns {
+        let col = |c: &Vec<f64>| c[from..].as_ptr() as *mut f64;
+        sn::novas_cat_columns {
+            ra: col(&self.ra),
+            dec: col(&self.dec),
+            promora: col(&self.pm_ra),
+            promodec: col(&self.pm_dec),
+            parallax: col(&self.parallax),
+            radialvelocity: col(&self.rv),
+        }
+    }
+
+    // The writable C view of all rows, e.g. for outputs
+    fn raw_mut(&mut self) -> sn::novas_cat_columns {
+        sn::novas_cat_columns {
+            ra: self.ra.as_mut_ptr(),
+            dec: self.dec.as_mut_ptr(),
+            promora: self.pm_ra.as_mut_ptr(),
+            promodec: self.pm_dec.as_mut_ptr(),
+            parallax: self.parallax.as_mut_ptr(),
+            radialvelocity: self.rv.as_mut_ptr(),
+        }
+    }
+
+    /// Moves the stars, in place, from the catalog epoch `from` to the epoch `to`, applying their
+    /// proper motions and radial velocities (see `transform_cat()`). The epochs are TT-based Julian
+    /// dates, or Julian years (e.g. 2016.0 for Gaia DR3). The columnar astrometry of [`Frame`]
+    /// expects ICRS positions at epoch J2000.
+    pub fn propagate(&mut self, from: f64, to: f64) -> Result<()> {
+        self.check()?;
+        let n = self.len();
+        let mut cols = self.raw_mut();
+        let cols: *mut sn::novas_cat_columns = &mut cols;
+        check("transform_cat_columns", unsafe {
+            sn::transform_cat_columns(sn::novas_transform_type_PROPER_MOTION, from, cols, n as _, to, cols)
+        })
+    }
+}
+
+/// An astronomical source: a star, a major planet, or a body from the ephemeris provider.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Source(sn::object);
+
+impl Source {
+    pub fn star(star: &Star) -> Result<Source> {
+        let mut obj = zeroed();
+        check("make_cat_object", unsafe { sn::make_cat_object(&star.0, &mut obj) })?;
+        Ok(Source(obj))
+    }
+
+    pub fn planet(planet: Planet) -> Result<Source> {
+        let mut obj = zeroed();
+        check("make_planet", unsafe { sn::make_planet(planet.raw(), &mut obj) })?;
+        Ok(Source(obj))
+    }
+
+    /// A body from the ephemeris provider, such as a minor planet, by its name and ID.
+    pub fn ephem(name: &str, id: i64) -> Result<Source> {
+        let cname = c_name::<{ sn::SIZE_OF_OBJ_NAME as usize }>(name);
+        let mut obj = zeroed();
+        check("make_ephem_object", unsafe { sn::make_ephem_object(cname.as_ptr(), id as _, &mut obj) })?;
+        Ok(Source(obj))
+    }
+
+    /// A body moving on Keplerian `orbit`, such as a satellite with geocentric orbital elements.
+    pub fn orbital(name: &str, id: i64, orbit: &sn::novas_orbital) -> Result<Source> {
+        let cname = c_name::<{ sn::SIZE_OF_OBJ_NAME as usize }>(name);
+        let mut obj = zeroed();
+        check("make_orbital_object", unsafe { sn::make_orbital_object(cname.as_ptr(), id as _, orbit, &mut obj) })?;
+        Ok(Source(obj))
+    }
+
+    pub fn as_raw(&self) -> &sn::object {
+        &self.0
+    }
+}
+
+/// Apparent position of a source, layout-compatible with `sky_pos` in SuperNOVAS.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+#[repr(C)]
+pub struct SkyPos {
+    /// Unit vector towards the source.
+    pub r_hat: [f64; 3],
+    /// [h] right ascension.
+    pub ra: f64,
+    /// [deg] declination.
+    pub dec: f64,
+    /// [AU] geometric distance, or 0 for sidereal sources.
+    pub dis: f64,
+    /// [km/s] spectroscopic radial velocity.
+    pub rv: f64,
+}
+
+const _: () = assert!(mem::size_of::<SkyPos>() == mem::size_of::<sn::sky_pos>());
+
+impl SkyPos {
+    fn as_raw_mut(&mut self) -> *mut sn::sky_pos {
+        self as *mut SkyPos as *mut sn::sky_pos
+    }
+}
+
+/// Observing geometry of a source, layout-compatible with `novas_obs_geometry` in SuperNOVAS.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+#[repr(C)]
+pub struct ObsGeometry {
+    /// [AU] distance from the Sun when the light left the source (NaN for sidereal sources).
+    pub helio_dist: f64,
+    /// [AU/day] rate of recession from the Sun (NaN for sidereal sources).
+    pub helio_rate: f64,
+    /// [AU] light-time corrected distance from the observer (NaN for sidereal sources).
+    pub obs_dist: f64,
+    /// [deg] phase angle, between the Sun and the observer, seen from the source.
+    pub phase: f64,
+    /// Solar illumination fraction of a spherical body at the source.
+    pub illum: f64,
+    /// [W/m^2] incident Solar power at the source (NaN for sidereal sources).
+    pub solar_power: f64,
+    /// [deg] apparent angular distance from the Sun.
+    pub elongation: f64,
+    /// [deg] apparent angular distance from the Moon.
+    pub moon_angle: f64,
+}
+
+const _: () = assert!(mem::size_of::<ObsGeometry>() == mem::size_of::<sn::novas_obs_geometry>());
+
+/// An observing frame: an observer location at a time of observation.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Frame(sn::novas_frame);
+
+impl Frame {
+    /// Frame for an observer at a time, with the Earth orientation parameters `dx`, `dy` [mas].
+    pub fn new(accuracy: Accuracy, obs: &Observer, time: &Time, dx: f64, dy: f64) -> Result<Frame> {
+        let _guard = shared();
+        Frame::make(accuracy, obs, time, dx, dy, std::ptr::null_mut())
+    }
+
+    // Frame calculation without locking, using a computation context (or NULL)
+    fn make(accuracy: Accuracy, obs: &Observer, time: &Time, dx: f64, dy: f64,
+        ctx: *mut sn::novas_context) -> Result<Frame> {
+        let mut frame = zeroed();
+        check("novas_make_frame_ctx", unsafe {
+            sn::novas_make_frame_ctx(ctx, accuracy.raw(), &obs.0, &time.0, dx, dy, &mut frame)
+        })?;
+        Ok(Frame(frame))
+    }
+
+    /// Frames for many observers at the same time, sharing the observer-independent quantities.
+    pub fn for_observers(accuracy: Accuracy, obs: &[Observer], time: &Time, dx: f64, dy: f64,
+        out: &mut [Frame]) -> Result<()> {
+        check_len(obs.len(), out.len())?;
+        let _guard = shared();
+        check("novas_make_frames_for_observers", unsafe {
+            sn::novas_make_frames_for_observers(accuracy.raw(), obs.as_ptr() as *const sn::observer, obs.len() as _,
+                &time.0, dx, dy, out.as_mut_ptr() as *mut sn::novas_frame)
+        })
+    }
+
+    pub fn time(&self) -> Time {
+        Time(self.0.time)
+    }
+
+    pub fn as_raw(&self) -> &sn::novas_frame {
+        &self.0
+    }
+
+    /// Advances the frame by `dt` seconds, recalculating only the Earth rotation and the observer
+    /// motion exactly, and extrapolating the rest, within `tol` [mas]. The frame is recalculated
+    /// in full once the tolerance, or the `horizon` [s] of accumulated advances (if positive),
+    /// would be exceeded.
+    pub fn advance(&mut self, dt: f64, tol: f64, horizon: f64) -> Result<()> {
+        let _guard = shared();
+        check("novas_advance_frame", unsafe { sn::novas_advance_frame(&mut self.0, dt, tol, horizon) })
+    }
+
+    /// Apparent position of a source in the given coordinate system.
+    pub fn sky_pos(&self, source: &Source, sys: System) -> Result<SkyPos> {
+        let _guard = shared();
+        self.sky_pos_unlocked(source, sys)
+    }
+
+    fn sky_pos_unlocked(&self, source: &Source, sys: System) -> Result<SkyPos> {
+        let mut pos = SkyPos::default();
+        check("novas_sky_pos", unsafe { sn::novas_sky_pos(&source.0, &self.0, sys.raw(), pos.as_raw_mut()) })?;
+        Ok(pos)
+    }
+
+    fn sky_pos_slice(&self, sources: &[Source], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        for (src, pos) in sources.iter().zip(out.iter_mut()) {
+            *pos = self.sky_pos_unlocked(src, sys)?;
+        }
+        Ok(())
+    }
+
+    fn star_pos_slice(&self, stars: &[Star], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check("novas_sky_pos_array", unsafe {
+            sn::novas_sky_pos_array(stars.as_ptr() as *const sn::cat_entry, stars.len() as _, &self.0, sys.raw(),
+                out.as_mut_ptr() as *mut sn::sky_pos)
+        })
+    }
+
+    /// Apparent positions of many sources, into `out`, which must have the same length.
+    pub fn sky_pos_into(&self, sources: &[Source], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check_len(sources.len(), out.len())?;
+        let _guard = shared();
+        self.sky_pos_slice(sources, sys, out)
+    }
+
+    /// Apparent positions of many catalog stars, into `out`, which must have the same length.
+    /// The stars are processed in blocks by the C library, which is faster than calling
+    /// [`Frame::sky_pos()`] for each.
+    pub fn star_pos_into(&self, stars: &[Star], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check_len(stars.len(), out.len())?;
+        let _guard = shared();
+        self.star_pos_slice(stars, sys, out)
+    }
+
+    fn geometry_slice(&self, sources: &[Source], out: &mut [ObsGeometry]) -> Result<()> {
+        check("novas_obs_geometry_array", unsafe {
+            sn::novas_obs_geometry_array(sources.as_ptr() as *const sn::object, sources.len() as _, &self.0,
+                out.as_mut_ptr() as *mut sn::novas_obs_geometry)
+        })
+    }
+
+    /// Observing geometries (distances, phase, elongation...) of many sources, into `out`, which must
+    /// have the same length. The apparent Sun and Moon are calculated once for all sources, and the
+    /// quantities of each source from a single light-time corrected state.
+    pub fn geometry_into(&self, sources: &[Source], out: &mut [ObsGeometry]) -> Result<()> {
+        check_len(sources.len(), out.len())?;
+        let _guard = shared();
+        self.geometry_slice(sources, out)
+    }
+
+    /// Same as [`Frame::geometry_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_geometry_into(&self, sources: &[Source], out: &mut [ObsGeometry]) -> Result<()> {
+        check_len(sources.len(), out.len())?;
+        let _guard = shared();
+        sources.par_chunks(PAR_CHUNK).zip(out.par_chunks_mut(PAR_CHUNK))
+            .try_for_each(|(src, geo)| self.geometry_slice(src, geo))
+    }
+
+    /// Same as [`Frame::sky_pos_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_sky_pos_into(&self, sources: &[Source], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check_len(sources.len(), out.len())?;
+        let _guard = shared();
+        sources.par_chunks(PAR_CHUNK).zip(out.par_chunks_mut(PAR_CHUNK))
+            .try_for_each(|(src, pos)| self.sky_pos_slice(src, sys, pos))
+    }
+
+    /// Same as [`Frame::star_pos_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_star_pos_into(&self, stars: &[Star], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check_len(stars.len(), out.len())?;
+        let _guard = shared();
+        stars.par_chunks(PAR_CHUNK).zip(out.par_chunks_mut(PAR_CHUNK))
+            .try_for_each(|(src, pos)| self.star_pos_slice(src, sys, pos))
+    }
+
+    fn columns_pos_slice(&self, stars: &StarColumns, from: usize, sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check("novas_sky_pos_columns", unsafe {
+            sn::novas_sky_pos_columns(&stars.raw(from), out.len() as _, &self.0, sys.raw(),
+                out.as_mut_ptr() as *mut sn::sky_pos)
+        })
+    }
+
+    /// Same as [`Frame::star_pos_into()`], but for stars in columns, which must be at epoch J2000
+    /// (see [`StarColumns::propagate()`]).
+    pub fn columns_pos_into(&self, stars: &StarColumns, sys: System, out: &mut [SkyPos]) -> Result<()> {
+        stars.check()?;
+        check_len(stars.len(), out.len())?;
+        let _guard = shared();
+        self.columns_pos_slice(stars, 0, sys, out)
+    }
+
+    /// Same as [`Frame::columns_pos_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_columns_pos_into(&self, stars: &StarColumns, sys: System, out: &mut [SkyPos]) -> Result<()> {
+        stars.check()?;
+        check_len(stars.len(), out.len())?;
+        let _guard = shared();
+        out.par_chunks_mut(PAR_CHUNK).enumerate()
+            .try_for_each(|(k, pos)| self.columns_pos_slice(stars, k * PAR_CHUNK, sys, pos))
+    }
+}
+
+/// The observer-independent part of observing frames at one time, from which frames for any
+/// number of observers are derived cheaply.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct EpochFrame(sn::novas_epoch_frame);
+
+impl EpochFrame {
+    pub fn new(accuracy: Accuracy, time: &Time, dx: f64, dy: f64) -> Result<EpochFrame> {
+        let mut epoch = zeroed();
+        let _guard = shared();
+        check("novas_make_epoch_frame", unsafe { sn::novas_make_epoch_frame(accuracy.raw(), &time.0, dx, dy, &mut epoch) })?;
+        Ok(EpochFrame(epoch))
+    }
+
+    /// The frame for an observer at this epoch.
+    pub fn frame(&self, obs: &Observer) -> Result<Frame> {
+        let mut frame = zeroed();
+        let _guard = shared();
+        check("novas_frame_for_observer", unsafe { sn::novas_frame_for_observer(&self.0, &obs.0, &mut frame) })?;
+        Ok(Frame(frame))
+    }
+}
+
+/// Frames for one observer over a sequence of times. The frame is recalculated only when the
+/// epoch changes, and the recalculations share the cached intermediate quantities (nutation,
+/// precession, CIO location...) of a private computation context.
+pub struct FrameCache {
+    accuracy: Accuracy,
+    observer: Observer,
+    dx: f64,
+    dy: f64,
+    ctx: sn::novas_context,
+    frame: Option<Frame>,
+}
+
+impl FrameCache {
+    pub fn new(accuracy: Accuracy, observer: &Observer, dx: f64, dy: f64) -> FrameCache {
+        FrameCache { accuracy, observer: *observer, dx, dy, ctx: zeroed(), frame: None }
+    }
+
+    /// The frame for the given time, reused from the previous call if the epoch is the same.
+    pub fn frame(&mut self, time: &Time) -> Result<&Frame> {
+        if !self.is_current(time) {
+            let _guard = shared();
+            self.update(time)?;
+        }
+        Ok(self.frame.as_ref().unwrap())
+    }
+
+    fn is_current(&self, time: &Time) -> bool {
+        self.frame.as_ref().is_some_and(|f| f.time().same_epoch(time))
+    }
+
+    // Recalculates the frame (without locking) if the epoch has changed.
+    fn update(&mut self, time: &Time) -> Result<&Frame> {
+        if !self.is_current(time) {
+            self.frame = Some(Frame::make(self.accuracy, &self.observer, time, self.dx, self.dy, &mut self.ctx)?);
+        }
+        Ok(self.frame.as_ref().unwrap())
+    }
+
+    fn track_slice(&mut self, source: &Source, times: &[Time], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        for (t, pos) in times.iter().zip(out.iter_mut()) {
+            *pos = self.update(t)?.sky_pos_unlocked(source, sys)?;
+        }
+        Ok(())
+    }
+
+    /// Apparent positions of a source at many times, into `out`, which must have the same length.
+    pub fn track_into(&mut self, source: &Source, times: &[Time], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check_len(times.len(), out.len())?;
+        let _guard = shared();
+        self.track_slice(source, times, sys, out)
+    }
+
+    /// Same as [`FrameCache::track_into()`], but on the Rayon pool, with a frame
+    /// cache per task that inherits this cache's settings.
+    #[cfg(feature = "rayon")]
+    pub fn par_track_into(&self, source: &Source, times: &[Time], sys: System, out: &mut [SkyPos]) -> Result<()> {
+        check_len(times.len(), out.len())?;
+        let _guard = shared();
+        times.par_chunks(PAR_CHUNK).zip(out.par_chunks_mut(PAR_CHUNK))
+            .try_for_each_init(|| FrameCache::new(self.accuracy, &self.observer, self.dx, self.dy),
+                |cache, (t, pos)| cache.track_slice(source, t, sys, pos))
+    }
+}
+
+/// Streaming apparent positions of one source, for one observer, at regular time steps, e.g. the
+/// Moon every 10 s for a month. Positions are produced one at a time (as an [`Iterator`]), or in
+/// chunks into reusable buffers, without allocating. Successive frames share the cached
+/// intermediate quantities of a private computation context (as in [`FrameCache`]), and the
+/// ephemeris states of solar-system bodies are interpolated between sparse provider queries, with
+/// light-time solutions warm-started from the previous step.
+///
+/// [`Track::fill_columns()`] writes the results as separate contiguous columns, such as the
+/// mutable slices of `ndarray` arrays or Arrow buffers, so they need not be copied into columnar
+/// storage afterwards.
+pub struct Track {
+    frames: FrameCache,
+    source: Source,
+    body: Option<sn::novas_body_cache>,
+    sys: System,
+    start: Time,
+    step: f64,
+    count: usize,
+    next: usize,
+}
+
+// [day] Spacing of the interpolated ephemeris states, which keeps the error below 1 cm for the Moon
+const TRACK_INTERVAL: f64 = 0.05;
+
+impl Track {
+    /// A stream of `count` positions of `source`, starting at `start`, every `step` seconds.
+    pub fn new(accuracy: Accuracy, observer: &Observer, dx: f64, dy: f64, source: &Source, sys: System,
+        start: &Time, step: f64, count: usize) -> Result<Track> {
+        let body = if source.0.type_ == sn::novas_object_type_NOVAS_CATALOG_OBJECT {
+            None
+        } else {
+            let mut cache = zeroed();
+            check("novas_init_body_cache", unsafe { sn::novas_init_body_cache(&source.0, TRACK_INTERVAL, &mut cache) })?;
+            Some(cache)
+        };
+
+        Ok(Track {
+            frames: FrameCache::new(accuracy, observer, dx, dy),
+            source: *source,
+            body,
+            sys,
+            start: *start,
+            step,
+            count,
+            next: 0,
+        })
+    }
+
+    /// The number of positions not yet produced.
+    pub fn remaining(&self) -> usize {
+        self.count - self.next
+    }
+
+    /// The time of the next position.
+    pub fn next_time(&self) -> Result<Time> {
+        self.start.offset(self.next as f64 * self.step)
+    }
+
+    // The next position, without locking
+    fn advance(&mut self) -> Result<SkyPos> {
+        let time = self.next_time()?;
+        self.next += 1;
+
+        let frame = self.frames.update(&time)?;
+        match self.body.as_mut() {
+            Some(cache) => {
+                let mut pos = SkyPos::default();
+                check("novas_sky_pos_cached", unsafe {
+                    sn::novas_sky_pos_cached(cache, &frame.0, self.sys.raw(), pos.as_raw_mut())
+                })?;
+                Ok(pos)
+            }
+            None => frame.sky_pos_unlocked(&self.source, self.sys),
+        }
+    }
+
+    /// Fills `out` with the next positions, returning how many were filled, which is less than the
+    /// length of `out` only at the end of the stream (0 once it is exhausted).
+    pub fn fill(&mut self, out: &mut [SkyPos]) -> Result<usize> {
+        let n = out.len().min(self.remaining());
+        let _guard = shared();
+        for pos in &mut out[..n] {
+            *pos = self.advance()?;
+        }
+        Ok(n)
+    }
+
+    /// Same as [`Track::fill()`], but into separate columns of right ascension [h], declination
+    /// [deg], distance [AU] and radial velocity [km/s], which must have the same length.
+    pub fn fill_columns(&mut self, ra: &mut [f64], dec: &mut [f64], dis: &mut [f64], rv: &mut [f64]) -> Result<usize> {
+        check_len(ra.len(), dec.len())?;
+        check_len(ra.len(), dis.len())?;
+        check_len(ra.len(), rv.len())?;
+
+        let n = ra.len().min(self.remaining());
+        let _guard = shared();
+        for i in 0..n {
+            let pos = self.advance()?;
+            ra[i] = pos.ra;
+            dec[i] = pos.dec;
+            dis[i] = pos.dis;
+            rv[i] = pos.rv;
+        }
+        Ok(n)
+    }
+}
+
+impl Iterator for Track {
+    type Item = Result<SkyPos>;
+
+    fn next(&mut self) -> Option<Result<SkyPos>> {
+        if self.next >= self.count {
+            return None;
+        }
+        let _guard = shared();
+        Some(self.advance())
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        (self.remaining(), Some(self.remaining()))
+    }
+}
+
+impl ExactSizeIterator for Track {}
+
+/// Monitoring counters of a [`FramePool`].
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct PoolStats {
+    /// Frames built by the background worker.
+    pub built: u64,
+    /// Requests served from the ring at once.
+    pub hits: u64,
+    /// Requests that had to wait for the worker to build the frame.
+    pub waits: u64,
+    /// Requests for times already behind the ring, which were calculated on the spot.
+    pub misses: u64,
+    /// Times the ring was restarted, for a request too far ahead of it.
+    pub resyncs: u64,
+    /// Total time spent waiting for the worker.
+    pub wait_time: Duration,
+    /// Longest single wait for the worker.
+    pub max_wait: Duration,
+}
+
+// Frames built ahead, at `origin + (first + k) * step` for the k-th frame in the ring
+struct PoolState {
+    ring: VecDeque<Frame>,
+    origin: Time,
+    first: i64,
+    generation: u64,
+    stop: bool,
+    error: Option<Error>,
+    stats: PoolStats,
+}
+
+struct PoolShared {
+    state: Mutex<PoolState>,
+    // Signals the worker that there is room in the ring (or to stop)
+    room: Condvar,
+    // Signals the consumers that a frame was added (or that the worker failed)
+    ready: Condvar,
+}
+
+impl PoolShared {
+    fn lock(&self) -> MutexGuard<'_, PoolState> {
+        self.state.lock().unwrap_or_else(|e| e.into_inner())
+    }
+}
+
+/// Frames for "now", for real-time pointing, built ahead of time on a background thread. The
+/// worker keeps a ring of frames at regular steps ahead of the requested times, so a request is
+/// served in constant time by copying the nearest frame of the ring, advanced to the exact time
+/// requested (see [`Frame::advance()`]). Frames behind the requested time are dropped, making room
+/// for the worker to build further ahead.
+///
+/// Requests are expected to move forward in time, about as fast as the frames are built. A request
+/// ahead of the ring waits for the worker, and one far ahead of it restarts the ring at the
+/// requested time, while one behind the ring is calculated on the spot. These cases are counted in
+/// the [`PoolStats`], for monitoring. If the worker fails to build a frame, the error is returned
+/// to the next request, and the worker tries again after it.
+pub struct FramePool {
+    shared: Arc<PoolShared>,
+    step: f64,
+    depth: usize,
+    tol: f64,
+    accuracy: Accuracy,
+    observer: Observer,
+    dx: f64,
+    dy: f64,
+    worker: Option<JoinHandle<()>>,
+}
+
+impl FramePool {
+    /// A pool of up to `depth` frames, every `step` seconds from `start`, for an observer with the
+    /// Earth orientation parameters `dx`, `dy` [mas]. Frames are advanced from the nearest frame in
+    /// the ring within `tol` [mas] (see [`Frame::advance()`]), so the step should be well within
+    /// the time the tolerance allows, e.g. a few seconds for 1 mas.
+    ///
+    /// # Panics
+    ///
+    /// If `step` is not positive, or `depth` is zero.
+    pub fn new(accuracy: Accuracy, observer: &Observer, dx: f64, dy: f64, start: &Time, step: f64, depth: usize,
+        tol: f64) -> FramePool {
+        assert!(step > 0.0, "frame pool step must be positive");
+        assert!(depth > 0, "frame pool depth must be positive");
+
+        let shared = Arc::new(PoolShared {
+            state: Mutex::new(PoolState {
+                ring: VecDeque::with_capacity(depth),
+                origin: *start,
+                first: 0,
+                generation: 0,
+                stop: false,
+                error: None,
+                stats: PoolStats::default(),
+            }),
+            room: Condvar::new(),
+            ready: Condvar::new(),
+        });
+
+        let worker = {
+            let pool = Arc::clone(&shared);
+            let observer = *observer;
+            thread::spawn(move || FramePool::build_ahead(&pool, accuracy, &observer, dx, dy, step, depth))
+        };
+
+        FramePool { shared, step, depth, tol, accuracy, observer: *observer, dx, dy, worker: Some(worker) }
+    }
+
+    // The worker loop, filling the ring as room is made
+    fn build_ahead(pool: &PoolShared, accuracy: Accuracy, observer: &Observer, dx: f64, dy: f64, step: f64,
+        depth: usize) {
+        let mut ctx: sn::novas_context = zeroed();
+        let mut state = pool.lock();
+
+        loop {
+            while !state.stop && (state.ring.len() >= depth || state.error.is_some()) {
+                state = pool.room.wait(state).unwrap_or_else(|e| e.into_inner());
+            }
+            if state.stop {
+                return;
+            }
+
+            let generation = state.generation;
+            let k = state.first + state.ring.len() as i64;
+            let origin = state.origin;
+            drop(state);
+
+            let frame = {
+                let _guard = shared();
+                origin.offset(k as f64 * step).and_then(|t| Frame::make(accuracy, observer, &t, dx, dy, &mut ctx))
+            };
+
+            state = pool.lock();
+            if state.generation != generation {
+                continue;
+            }
+            match frame {
+                Ok(f) => {
+                    state.ring.push_back(f);
+                    state.stats.built += 1;
+                }
+                Err(e) => state.error = Some(e),
+            }
+            pool.ready.notify_all();
+        }
+    }
+
+    /// The frame for `time`, from the nearest frame in the ring, advanced to the exact time.
+    pub fn frame(&self, time: &Time) -> Result<Frame> {
+        let mut state = self.shared.lock();
+        let mut waited: Option<Instant> = None;
+
+        let mut frame = loop {
+            // A failed build is reported once, and the worker retries it on the next request.
+            if let Some(e) = state.error.take() {
+                self.shared.room.notify_one();
+                return Err(e);
+            }
+
+            let k = (time.since(&state.origin) / self.step).round() as i64 - state.first;
+
+            if k < 0 {
+                state.stats.misses += 1;
+                drop(state);
+                return Frame::new(self.accuracy, &self.observer, time, self.dx, self.dy);
+            }
+
+            if k as usize >= self.depth + state.ring.len() {
+                // Too far ahead to wait for: restart the ring at the requested time.
+                state.ring.clear();
+                state.origin = *time;
+                state.first = 0;
+                state.generation += 1;
+                state.stats.resyncs += 1;
+                self.shared.room.notify_one();
+            }
+            else if (k as usize) < state.ring.len() {
+                state.ring.drain(..k as usize);
+                state.first += k;
+                self.shared.room.notify_one();
+                break state.ring[0];
+            }
+            else if !state.ring.is_empty() {
+                // Ahead of the ring: the frames built so far are behind, so they make room for the
+                // worker to build the requested one.
+                state.first += state.ring.len() as i64;
+                state.ring.clear();
+                self.shared.room.notify_one();
+            }
+
+            if waited.is_none() {
+                waited = Some(Instant::now());
+                state.stats.waits += 1;
+            }
+            state = self.shared.ready.wait(state).unwrap_or_else(|e| e.into_inner());
+        };
+
+        match waited {
+            Some(t0) => {
+                let dt = t0.elapsed();
+                state.stats.wait_time += dt;
+                state.stats.max_wait = state.stats.max_wait.max(dt);
+            }
+            None => state.stats.hits += 1,
+        }
+        drop(state);
+
+        let dt = time.since(&frame.time());
+        if dt != 0.0 {
+            frame.advance(dt, self.tol, 0.0)?;
+        }
+        Ok(frame)
+    }
+
+    /// The monitoring counters so far.
+    pub fn stats(&self) -> PoolStats {
+        self.shared.lock().stats
+    }
+
+    /// The number of frames currently built ahead.
+    pub fn ready(&self) -> usize {
+        self.shared.lock().ring.len()
+    }
+}
+
+impl Drop for FramePool {
+    fn drop(&mut self) {
+        self.shared.lock().stop = true;
+        self.shared.room.notify_all();
+        if let Some(worker) = self.worker.take() {
+            let _ = worker.join();
+        }
+    }
+}
+
+/// Differential reduction of the stars in a narrow field, e.g. for guide stars or plate solutions.
+/// The gravitational deflection is modeled across the field once, from exact evaluations through a
+/// frame, while the proper motion, parallax and aberration of each star are calculated exactly.
+/// Hence, it is not orders of magnitude faster than [`Frame::star_pos_into()`]: ~4.5 times on
+/// x86_64 Linux CPUs with AVX-512 (where the loop is vectorized), but only ~1.35 times otherwise
+/// (or with `SUPERNOVAS_NO_DISPATCH`), with the model error reported by [`Field::max_error()`].
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Field(sn::novas_field);
+
+impl Field {
+    /// A field around the ICRS position `ra` [h], `dec` [deg], of `radius` [deg], with apparent
+    /// positions in the system `sys`.
+    pub fn new(frame: &Frame, ra: f64, dec: f64, radius: f64, sys: System) -> Result<Field> {
+        let mut field = zeroed();
+        let _guard = shared();
+        check("novas_make_field", unsafe { sn::novas_make_field(&frame.0, ra, dec, radius, sys.raw(), &mut field) })?;
+        Ok(Field(field))
+    }
+
+    /// [mas] The largest error of the deflection model found within the field radius.
+    pub fn max_error(&self) -> f64 {
+        self.0.max_error
+    }
+
+    fn star_pos_slice(&self, stars: &[Star], out: &mut [SkyPos]) -> Result<()> {
+        check("novas_field_sky_pos", unsafe {
+            sn::novas_field_sky_pos(&self.0, stars.as_ptr() as *const sn::cat_entry, stars.len() as _,
+                out.as_mut_ptr() as *mut sn::sky_pos)
+        })
+    }
+
+    /// Apparent positions of catalog stars in the field, into `out`, which must have the same length.
+    /// Radial velocities are not calculated, and are NaN.
+    pub fn star_pos_into(&self, stars: &[Star], out: &mut [SkyPos]) -> Result<()> {
+        check_len(stars.len(), out.len())?;
+        self.star_pos_slice(stars, out)
+    }
+
+    /// Same as [`Field::star_pos_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_star_pos_into(&self, stars: &[Star], out: &mut [SkyPos]) -> Result<()> {
+        check_len(stars.len(), out.len())?;
+        stars.par_chunks(PAR_CHUNK).zip(out.par_chunks_mut(PAR_CHUNK))
+            .try_for_each(|(src, pos)| self.star_pos_slice(src, pos))
+    }
+}
+
+/// Pixel-level mapping between observed horizontal (Az/El) and apparent equatorial (R.A./Dec)
+/// coordinates, e.g. for reprojecting all-sky camera images. It is set up from a few exact
+/// conversions through a frame, and a refraction table, after which each pixel is a constant-time
+/// calculation in single precision. The mapping is updated for later frames (or shifted to nearby
+/// times) without recalculating the refraction table.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct AllSky(sn::novas_allsky);
+
+impl AllSky {
+    pub fn new(frame: &Frame, refraction: Refraction, sys: System) -> Result<AllSky> {
+        let (model, microns) = refraction.raw();
+        let mut map = zeroed();
+        check("novas_make_allsky", unsafe { sn::novas_make_allsky(&frame.0, model, microns, sys.raw(), &mut map) })?;
+        Ok(AllSky(map))
+    }
+
+    /// Updates the mapping for another frame of the same observer.
+    pub fn set_frame(&mut self, frame: &Frame) -> Result<()> {
+        check("novas_allsky_set_frame", unsafe { sn::novas_allsky_set_frame(&frame.0, &mut self.0) })
+    }
+
+    /// Moves the mapping forward by `dt` seconds (of UT1), rotating it with Earth. Precession,
+    /// nutation and polar motion are held fixed, which is accurate to 1 mas for a few minutes.
+    pub fn shift(&mut self, dt: f64) -> Result<()> {
+        check("novas_shift_allsky", unsafe { sn::novas_shift_allsky(dt, &mut self.0) })
+    }
+
+    fn hor_to_app_slice(&self, az: &[f32], el: &[f32], ra: &mut [f32], dec: &mut [f32]) -> Result<()> {
+        check("novas_allsky_hor_to_app", unsafe {
+            sn::novas_allsky_hor_to_app(&self.0, az.as_ptr(), el.as_ptr(), az.len() as _, ra.as_mut_ptr(),
+                dec.as_mut_ptr())
+        })
+    }
+
+    fn app_to_hor_slice(&self, ra: &[f32], dec: &[f32], az: &mut [f32], el: &mut [f32]) -> Result<()> {
+        check("novas_allsky_app_to_hor", unsafe {
+            sn::novas_allsky_app_to_hor(&self.0, ra.as_ptr(), dec.as_ptr(), ra.len() as _, az.as_mut_ptr(),
+                el.as_mut_ptr())
+        })
+    }
+
+    /// [h, deg] Apparent R.A. and declination, into `ra` and `dec`, for observed azimuths and
+    /// elevations [deg]. All slices must have the same length.
+    pub fn hor_to_app_into(&self, az: &[f32], el: &[f32], ra: &mut [f32], dec: &mut [f32]) -> Result<()> {
+        check_len(az.len(), el.len())?;
+        check_len(az.len(), ra.len())?;
+        check_len(az.len(), dec.len())?;
+        self.hor_to_app_slice(az, el, ra, dec)
+    }
+
+    /// [deg] Observed azimuths and elevations, into `az` and `el`, for apparent R.A. [h] and
+    /// declinations [deg]. All slices must have the same length.
+    pub fn app_to_hor_into(&self, ra: &[f32], dec: &[f32], az: &mut [f32], el: &mut [f32]) -> Result<()> {
+        check_len(ra.len(), dec.len())?;
+        check_len(ra.len(), az.len())?;
+        check_len(ra.len(), el.len())?;
+        self.app_to_hor_slice(ra, dec, az, el)
+    }
+
+    /// Same as [`AllSky::hor_to_app_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_hor_to_app_into(&self, az: &[f32], el: &[f32], ra: &mut [f32], dec: &mut [f32]) -> Result<()> {
+        check_len(az.len(), el.len())?;
+        check_len(az.len(), ra.len())?;
+        check_len(az.len(), dec.len())?;
+        az.par_chunks(PIXEL_CHUNK).zip(el.par_chunks(PIXEL_CHUNK))
+            .zip(ra.par_chunks_mut(PIXEL_CHUNK).zip(dec.par_chunks_mut(PIXEL_CHUNK)))
+            .try_for_each(|((a, e), (r, d))| self.hor_to_app_slice(a, e, r, d))
+    }
+
+    /// Same as [`AllSky::app_to_hor_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_app_to_hor_into(&self, ra: &[f32], dec: &[f32], az: &mut [f32], el: &mut [f32]) -> Result<()> {
+        check_len(ra.len(), dec.len())?;
+        check_len(ra.len(), az.len())?;
+        check_len(ra.len(), el.len())?;
+        ra.par_chunks(PIXEL_CHUNK).zip(dec.par_chunks(PIXEL_CHUNK))
+            .zip(az.par_chunks_mut(PIXEL_CHUNK).zip(el.par_chunks_mut(PIXEL_CHUNK)))
+            .try_for_each(|((r, d), (a, e))| self.app_to_hor_slice(r, d, a, e))
+    }
+}
+
+/// Barycentering of event times, e.g. of photons in X-ray event lists, or pulsar times of
+/// arrival. The observer and Sun states, relative to the Solar System Barycenter, and the TDB - TT
+/// difference at the observer are tabulated once for the span of the observation, after which each
+/// event is a constant-time interpolation, adding the Einstein, Roemer, and solar Shapiro delays.
+pub struct BaryTable(sn::novas_bary_table);
+
+// The table owns its nodes, which are not modified after it is created.
+unsafe impl Send for BaryTable {}
+unsafe impl Sync for BaryTable {}
+
+impl BaryTable {
+    /// A table covering `span` seconds from `start`, with nodes every `step` seconds (or 0 for the
+    /// default, which is accurate to 1 ns for observers on Earth).
+    pub fn new(accuracy: Accuracy, observer: &Observer, start: &Time, span: f64, step: f64, dx: f64, dy: f64)
+        -> Result<BaryTable> {
+        let mut table = zeroed();
+        let _guard = shared();
+        check("novas_make_bary_table", unsafe {
+            sn::novas_make_bary_table(accuracy.raw(), &observer.0, &start.0, span, step, dx, dy, &mut table)
+        })?;
+        Ok(BaryTable(table))
+    }
+
+    /// A table for an observer in Earth orbit, e.g. an X-ray satellite, whose geocentric GCRS position
+    /// [km] and velocity [km/s] at each node are returned by `state`, e.g. from an orbit propagator, or
+    /// `None` if not available. Low orbits need steps of ~10 s for 1 ns accuracy.
+    pub fn new_orbit<F>(accuracy: Accuracy, start: &Time, span: f64, step: f64, mut state: F) -> Result<BaryTable>
+    where
+        F: FnMut(&Time) -> Option<([f64; 3], [f64; 3])>,
+    {
+        unsafe extern "C" fn trampoline<F>(time: *const sn::novas_timespec, arg: *mut c_void, pos: *mut f64,
+            vel: *mut f64) -> c_int
+        where
+            F: FnMut(&Time) -> Option<([f64; 3], [f64; 3])>,
+        {
+            let state = unsafe { &mut *(arg as *mut F) };
+            match state(unsafe { &*(time as *const Time) }) {
+                Some((p, v)) => {
+                    unsafe {
+                        pos.copy_from_nonoverlapping(p.as_ptr(), 3);
+                        vel.copy_from_nonoverlapping(v.as_ptr(), 3);
+                    }
+                    0
+                }
+                None => 1,
+            }
+        }
+
+        let mut table = zeroed();
+        let _guard = shared();
+        check("novas_make_orbit_bary_table", unsafe {
+            sn::novas_make_orbit_bary_table(accuracy.raw(), Some(trampoline::<F>), &mut state as *mut F as *mut c_void,
+                &start.0, span, step, &mut table)
+        })?;
+        Ok(BaryTable(table))
+    }
+
+    /// The time of the first node, relative to which event times are measured.
+    pub fn start(&self) -> Time {
+        Time(self.0.start)
+    }
+
+    fn times_slice(&self, ra: f64, dec: f64, dt: &[f64], out: &mut [f64]) -> Result<usize> {
+        // novas_bary_times() counts events in an int, so longer event lists go in parts
+        dt.chunks(c_int::MAX as usize).zip(out.chunks_mut(c_int::MAX as usize)).try_fold(0, |n, (t, o)| {
+            let res = unsafe { sn::novas_bary_times(&self.0, ra, dec, t.as_ptr(), t.len() as c_int, o.as_mut_ptr()) };
+            if res < 0 { Err(Error::Novas { func: "novas_bary_times", code: res }) } else { Ok(n + res as usize) }
+        })
+    }
+
+    /// [s] Barycentric (TDB) arrival times, into `out`, for event times `dt` [s] (TT) since the start of the
+    /// table, from a source at the ICRS `ra` [h] and `dec` [deg]. Outputs are relative to the Julian date of
+    /// the start, but in TDB. Returns the number of events outside of the table, whose outputs are NaN.
+    pub fn times_into(&self, ra: f64, dec: f64, dt: &[f64], out: &mut [f64]) -> Result<usize> {
+        check_len(dt.len(), out.len())?;
+        self.times_slice(ra, dec, dt, out)
+    }
+
+    /// Same as [`BaryTable::times_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_times_into(&self, ra: f64, dec: f64, dt: &[f64], out: &mut [f64]) -> Result<usize> {
+        check_len(dt.len(), out.len())?;
+        dt.par_chunks(EVENT_CHUNK).zip(out.par_chunks_mut(EVENT_CHUNK))
+            .map(|(t, o)| self.times_slice(ra, dec, t, o))
+            .try_reduce(|| 0, |a, b| Ok(a + b))
+    }
+}
+
+impl Drop for BaryTable {
+    fn drop(&mut self) {
+        unsafe { sn::novas_free_bary_table(&mut self.0) };
+    }
+}
+
+/// A satellite pass over a ground site, layout-compatible with `novas_pass` in SuperNOVAS. Times are
+/// TT seconds since the start of the [`PassPredictor`].
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+#[repr(C)]
+pub struct Pass {
+    /// Index of the site in the list of sites.
+    pub site: i32,
+    /// [s] Time of rising above the elevation limit, or NaN if above it at the start.
+    pub rise: f64,
+    /// [s] Time of the highest elevation.
+    pub culmination: f64,
+    /// [s] Time of setting below the elevation limit, or NaN if above it at the end.
+    pub set: f64,
+    /// [deg] Highest (unrefracted) elevation.
+    pub max_el: f64,
+}
+
+const _: () = assert!(mem::size_of::<Pass>() == mem::size_of::<sn::novas_pass>());
+
+/// Pass predictions for satellites over ground sites, e.g. for constellations and station networks.
+/// Satellite positions are sampled coarsely and screened against the sites' visibility cones, and
+/// only the surviving candidates are refined with exact positions. The Earth orientation over the
+/// span is interpolated from a grid, which is shared by all satellites.
+pub struct PassPredictor(sn::novas_earth_grid);
+
+// The grid owns its nodes, which are not modified after it is created.
+unsafe impl Send for PassPredictor {}
+unsafe impl Sync for PassPredictor {}
+
+// [mas] Interpolation error of the Earth orientation, i.e. < 3 cm for satellite positions
+const PASS_GRID_TOL: f64 = 1.0;
+
+impl PassPredictor {
+    /// Predictions over `span` days from `start`, using the UT1 offset of the start time, and no polar
+    /// motion, which is more than adequate for pass times.
+    pub fn new(accuracy: Accuracy, start: &Time, span: f64) -> Result<PassPredictor> {
+        let mut grid = zeroed();
+        check("novas_make_earth_grid", unsafe {
+            sn::novas_make_earth_grid(accuracy.raw(), &start.0, span, std::ptr::null(), std::ptr::null(),
+                std::ptr::null(), std::ptr::null(), 0, PASS_GRID_TOL, &mut grid)
+        })?;
+        Ok(PassPredictor(grid))
+    }
+
+    fn find(&self, sat: &Source, sites: &[sn::on_surface], el: f64, step: f64) -> Result<Vec<Pass>> {
+        let mut passes: Vec<Pass> = Vec::new();
+        loop {
+            let n = unsafe {
+                sn::novas_find_passes(&self.0, &sat.0, sites.as_ptr(), sites.len() as _, el, step,
+                    passes.as_mut_ptr() as *mut sn::novas_pass, passes.len() as _)
+            };
+            if n < 0 {
+                return Err(Error::Novas { func: "novas_find_passes", code: n });
+            }
+            if n as usize <= passes.len() {
+                passes.truncate(n as usize);
+                return Ok(passes);
+            }
+            passes.resize(n as usize, Pass::default());
+        }
+    }
+
+    fn sites(sites: &[Observer]) -> Vec<sn::on_surface> {
+        sites.iter().map(|o| o.0.on_surf).collect()
+    }
+
+    /// The passes of `sat` above `el` [deg] over Earth-bound `sites`, by site, and chronologically for
+    /// each site. Positions are sampled every `step` seconds for screening (or 0 for the default).
+    pub fn passes(&self, sat: &Source, sites: &[Observer], el: f64, step: f64) -> Result<Vec<Pass>> {
+        let _guard = shared();
+        self.find(sat, &PassPredictor::sites(sites), el, step)
+    }
+
+    /// The passes of each of `sats` over the sites, as [`PassPredictor::passes()`], on the Rayon pool,
+    /// one satellite (for all sites) per task.
+    #[cfg(feature = "rayon")]
+    pub fn par_passes(&self, sats: &[Source], sites: &[Observer], el: f64, step: f64) -> Result<Vec<Vec<Pass>>> {
+        let sites = PassPredictor::sites(sites);
+        let _guard = shared();
+        sats.par_iter().map(|sat| self.find(sat, &sites, el, step)).collect()
+    }
+}
+
+impl Drop for PassPredictor {
+    fn drop(&mut self) {
+        unsafe { sn::novas_free_earth_grid(&mut self.0) };
+    }
+}
+
+/// Geocentric positions and velocities for a network of Earth-bound stations, e.g. for VLBI or SLR.
+/// The geodetic to geocentric conversion of the sites is done once, when the table is created, and the
+/// Earth orientation is calculated once per epoch, for all stations together.
+pub struct StationTable(sn::novas_station_table);
+
+// The table owns its positions, which are not modified after it is created.
+unsafe impl Send for StationTable {}
+unsafe impl Sync for StationTable {}
+
+impl StationTable {
+    /// A table of the Earth-bound `sites`, in the same order.
+    pub fn new(sites: &[Observer]) -> Result<StationTable> {
+        let sites: Vec<sn::on_surface> = sites.iter().map(|o| o.0.on_surf).collect();
+        let mut table = zeroed();
+        check("novas_make_station_table", unsafe {
+            sn::novas_make_station_table(sites.as_ptr(), sites.len() as _, &mut table)
+        })?;
+        Ok(StationTable(table))
+    }
+
+    /// The number of stations in the table.
+    pub fn len(&self) -> usize {
+        self.0.n as usize
+    }
+
+    /// Whether the table has no stations.
+    pub fn is_empty(&self) -> bool {
+        self.0.n == 0
+    }
+
+    fn posvel_unlocked(&self, time: &Time, accuracy: Accuracy, pos: &mut [[f64; 3]], vel: &mut [[f64; 3]])
+        -> Result<()> {
+        check("novas_station_posvel", unsafe {
+            sn::novas_station_posvel(&self.0, &time.0, accuracy.raw(), pos.as_mut_ptr() as *mut f64,
+                vel.as_mut_ptr() as *mut f64)
+        })
+    }
+
+    /// [AU, AU/day] Geocentric GCRS positions and velocities of all stations at `time`, into `pos` and
+    /// `vel`, which must have the same length as the table.
+    pub fn posvel_into(&self, time: &Time, accuracy: Accuracy, pos: &mut [[f64; 3]], vel: &mut [[f64; 3]])
+        -> Result<()> {
+        check_len(self.len(), pos.len())?;
+        check_len(self.len(), vel.len())?;
+        let _guard = shared();
+        self.posvel_unlocked(time, accuracy, pos, vel)
+    }
+
+    /// Station positions and velocities at many epochs, on the Rayon pool, one epoch per task. `pos` and
+    /// `vel` hold the stations of each epoch contiguously, i.e. `times.len()` times the table length.
+    #[cfg(feature = "rayon")]
+    pub fn par_posvel_into(&self, times: &[Time], accuracy: Accuracy, pos: &mut [[f64; 3]],
+        vel: &mut [[f64; 3]]) -> Result<()> {
+        check_len(times.len() * self.len(), pos.len())?;
+        check_len(times.len() * self.len(), vel.len())?;
+        if self.is_empty() {
+            return Ok(());
+        }
+        let _guard = shared();
+        times.par_iter().zip(pos.par_chunks_mut(self.len()).zip(vel.par_chunks_mut(self.len())))
+            .try_for_each(|(t, (p, v))| self.posvel_unlocked(t, accuracy, p, v))
+    }
+}
+
+impl Drop for StationTable {
+    fn drop(&mut self) {
+        unsafe { sn::novas_free_station_table(&mut self.0) };
+    }
+}
+
+/// Earth occultation screening of catalog stars on a regular time grid, e.g. for scheduling a space
+/// telescope in low Earth orbit. The observer's position and the Earth's limb are calculated once per
+/// time step, for all stars, which are screened in the directions of their ICRS catalog coordinates.
+pub struct LimbScreen {
+    steps: usize,
+    mask: Vec<u8>,
+    enter: Vec<f64>,
+    leave: Vec<f64>,
+}
+
+impl LimbScreen {
+    fn screen(accuracy: Accuracy, observers: &[Observer], start: &Time, step: f64, steps: usize, stars: &[Star],
+        min_limb: f64, mask: &mut [u8], enter: &mut [f64], leave: &mut [f64]) -> Result<()> {
+        check("novas_limb_screen", unsafe {
+            sn::novas_limb_screen(observers.as_ptr() as *const sn::observer, observers.len() as _, &start.0, step,
+                steps as _, stars.as_ptr() as *const sn::cat_entry, stars.len() as _, min_limb, accuracy.raw(),
+                mask.as_mut_ptr(), enter.as_mut_ptr(), leave.as_mut_ptr())
+        })
+    }
+
+    fn alloc(steps: usize, stars: usize) -> LimbScreen {
+        LimbScreen {
+            steps,
+            mask: vec![0; stars * steps.div_ceil(8)],
+            enter: vec![f64::NAN; stars],
+            leave: vec![f64::NAN; stars],
+        }
+    }
+
+    /// Screens `stars` at `steps` times, `step` seconds apart from `start`, for being at least
+    /// `min_limb` [deg] above the Earth's limb. `observers` holds the observer location at each time
+    /// step (e.g. along a spacecraft orbit), or a single location for all of them.
+    pub fn new(accuracy: Accuracy, observers: &[Observer], start: &Time, step: f64, steps: usize, stars: &[Star],
+        min_limb: f64) -> Result<LimbScreen> {
+        let mut s = LimbScreen::alloc(steps, stars.len());
+        let _guard = shared();
+        LimbScreen::screen(accuracy, observers, start, step, steps, stars, min_limb, &mut s.mask, &mut s.enter,
+            &mut s.leave)?;
+        Ok(s)
+    }
+
+    /// Same as [`LimbScreen::new()`], but screening blocks of stars on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_new(accuracy: Accuracy, observers: &[Observer], start: &Time, step: f64, steps: usize,
+        stars: &[Star], min_limb: f64) -> Result<LimbScreen> {
+        if steps == 0 || stars.is_empty() {
+            return LimbScreen::new(accuracy, observers, start, step, steps, stars, min_limb);
+        }
+        let mut s = LimbScreen::alloc(steps, stars.len());
+        let nb = steps.div_ceil(8);
+        let _guard = shared();
+        stars.par_chunks(PAR_CHUNK).zip(s.mask.par_chunks_mut(PAR_CHUNK * nb))
+            .zip(s.enter.par_chunks_mut(PAR_CHUNK).zip(s.leave.par_chunks_mut(PAR_CHUNK)))
+            .try_for_each(|((st, m), (e, l))| {
+                LimbScreen::screen(accuracy, observers, start, step, steps, st, min_limb, m, e, l)
+            })?;
+        Ok(s)
+    }
+
+    /// The number of stars screened.
+    pub fn len(&self) -> usize {
+        self.enter.len()
+    }
+
+    /// Whether no stars were screened.
+    pub fn is_empty(&self) -> bool {
+        self.enter.is_empty()
+    }
+
+    /// The visibility bitmask of the `star`-th star, in which bit `k & 7` of byte `k >> 3` is set if
+    /// the star is visible at time step `k`.
+    pub fn mask(&self, star: usize) -> &[u8] {
+        let nb = self.steps.div_ceil(8);
+        &self.mask[star * nb..(star + 1) * nb]
+    }
+
+    /// Whether the `star`-th star is visible at time step `k`.
+    pub fn visible(&self, star: usize, k: usize) -> bool {
+        assert!(k < self.steps, "time step {k} out of range");
+        (self.mask(star)[k >> 3] >> (k & 7)) & 1 != 0
+    }
+
+    /// [s] Times (since the start) at which each star first rises above the limit, or NaN if it does
+    /// not rise within the time grid.
+    pub fn enter(&self) -> &[f64] {
+        &self.enter
+    }
+
+    /// [s] Times (since the start) at which each star first sets below the limit, or NaN if it does
+    /// not set within the time grid.
+    pub fn leave(&self) -> &[f64] {
+        &self.leave
+    }
+}
+
+/// The coordinate axes of the offsets of a [`Scan`].
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum ScanAxes {
+    /// Projected offsets along azimuth and elevation.
+    Horizontal,
+    /// Projected offsets along the true-of-date R.A. and declination.
+    Equatorial,
+}
+
+impl ScanAxes {
+    fn raw(self) -> sn::novas_scan_axes {
+        match self {
+            ScanAxes::Horizontal => sn::novas_scan_axes_NOVAS_SCAN_HORIZONTAL,
+            ScanAxes::Equatorial => sn::novas_scan_axes_NOVAS_SCAN_EQUATORIAL,
+        }
+    }
+}
+
+/// A time-stamped pointing command of an on-the-fly scan, layout-compatible with `novas_scan_cmd` in
+/// SuperNOVAS.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+#[repr(C)]
+pub struct ScanCommand {
+    /// [s] Time of the command, since the start of the buffer.
+    pub t: f64,
+    /// [deg] Commanded azimuth.
+    pub az: f64,
+    /// [deg] Commanded elevation.
+    pub el: f64,
+    /// [deg/s] Commanded azimuth rate.
+    pub az_rate: f64,
+    /// [deg/s] Commanded elevation rate.
+    pub el_rate: f64,
+    /// [arcsec] Projected offset from the center along azimuth.
+    pub daz: f64,
+    /// [arcsec] Offset from the center along elevation.
+    pub del: f64,
+    /// [deg] Parallactic angle at the center.
+    pub pa: f64,
+}
+
+const _: () = assert!(mem::size_of::<ScanCommand>() == mem::size_of::<sn::novas_scan_cmd>());
+
+/// An on-the-fly (OTF) mapping pattern of offsets [arcsec] around a tracked source, e.g. for radio
+/// mapping. `angle` [deg] rotates the pattern counter-clockwise from the longitude direction.
+#[derive(Clone, Copy)]
+#[repr(transparent)]
+pub struct Scan(sn::novas_scan);
+
+impl Scan {
+    /// Rows of `width` back and forth at `speed` [arcsec/s], `spacing` apart across `height`, taking
+    /// `turn` seconds to step between rows.
+    pub fn raster(width: f64, height: f64, spacing: f64, speed: f64, turn: f64, axes: ScanAxes, angle: f64)
+        -> Result<Scan> {
+        let mut scan = zeroed();
+        check("novas_make_raster_scan", unsafe {
+            sn::novas_make_raster_scan(width, height, spacing, speed, turn, axes.raw(), angle, &mut scan)
+        })?;
+        Ok(Scan(scan))
+    }
+
+    /// A Lissajous curve of `width` by `height`, with periods `x_period` and `y_period` [s].
+    pub fn lissajous(width: f64, height: f64, x_period: f64, y_period: f64, axes: ScanAxes, angle: f64)
+        -> Result<Scan> {
+        let mut scan = zeroed();
+        check("novas_make_lissajous_scan", unsafe {
+            sn::novas_make_lissajous_scan(width, height, x_period, y_period, axes.raw(), angle, &mut scan)
+        })?;
+        Ok(Scan(scan))
+    }
+
+    /// A daisy of `diameter`, oscillating radially with `radial_period` [s], and rotating with
+    /// `rotation_period` [s].
+    pub fn daisy(diameter: f64, radial_period: f64, rotation_period: f64, axes: ScanAxes, angle: f64)
+        -> Result<Scan> {
+        let mut scan = zeroed();
+        check("novas_make_daisy_scan", unsafe {
+            sn::novas_make_daisy_scan(diameter, radial_period, rotation_period, axes.raw(), angle, &mut scan)
+        })?;
+        Ok(Scan(scan))
+    }
+
+    /// Pointing commands at `rate` [Hz] into `out`, around `source` from the time of the (Earth-bound)
+    /// `frame`, starting `phase` seconds into the pattern. The parallactic angle and the projection
+    /// are updated every `tick` seconds. The center follows a horizontal track, which is accurate for
+    /// a minute or so, and so longer scans should be commanded in parts from successive frames.
+    pub fn commands_into(&self, frame: &Frame, source: &Source, refraction: Refraction, phase: f64, rate: f64,
+        tick: f64, out: &mut [ScanCommand]) -> Result<()> {
+        let (model, microns) = refraction.raw();
+        let mut track = zeroed();
+        if let Refraction::Wave(_) = refraction {
+            let _guard = exclusive();
+            check("novas_refract_wavelength", unsafe { sn::novas_refract_wavelength(microns) })?;
+            check("novas_hor_track", unsafe { sn::novas_hor_track(&source.0, &frame.0, model, &mut track) })?;
+        } else {
+            let _guard = shared();
+            check("novas_hor_track", unsafe { sn::novas_hor_track(&source.0, &frame.0, model, &mut track) })?;
+        }
+        check("novas_scan_commands", unsafe {
+            sn::novas_scan_commands(&self.0, &track, frame.0.observer.on_surf.latitude, &frame.0.time, phase, rate,
+                tick, out.len() as _, out.as_mut_ptr() as *mut sn::novas_scan_cmd)
+        })
+    }
+}
+
+/// Deviations of sampled reduced-accuracy calculations from their full-accuracy counterparts.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+#[repr(C)]
+pub struct AccuracyStats {
+    /// Number of sampled frames compared.
+    pub frames: c_long,
+    /// Number of sampled apparent positions compared.
+    pub positions: c_long,
+    /// Number of samples that could not be recalculated at full accuracy.
+    pub failed: c_long,
+    /// Number of samples dropped, because the queue was full.
+    pub dropped: c_long,
+    /// Number of samples waiting to be recalculated.
+    pub pending: c_long,
+    /// [mas] RMS deviation of the frame orientations.
+    pub frame_rms: f64,
+    /// [mas] Largest deviation of the frame orientations.
+    pub frame_max: f64,
+    /// [m] Largest deviation of the observer positions.
+    pub obs_max: f64,
+    /// [mas] RMS deviation of the apparent positions.
+    pub pos_rms: f64,
+    /// [mas] Largest deviation of the apparent positions.
+    pub pos_max: f64,
+    /// [m/s] Largest deviation of the radial velocities.
+    pub rv_max: f64,
+}
+
+const _: () = assert!(mem::size_of::<AccuracyStats>() == mem::size_of::<sn::novas_accuracy_stats>());
+
+/// Process-wide monitor of the reduced-accuracy calculations, which recalculates a fraction of
+/// the frames and positions at full accuracy on a background thread, so the reduced-accuracy
+/// fast paths can be justified by the errors they actually incur. The full-accuracy calculations
+/// use the configured ephemeris providers, so stop the monitor before swapping them.
+pub struct AccuracyMonitor;
+
+impl AccuracyMonitor {
+    /// Starts sampling every 1 / `fraction` reduced-accuracy frames, and positions, in each thread,
+    /// queuing up to `queue` samples (or 0 for the default), beyond which samples are dropped.
+    pub fn start(fraction: f64, queue: usize) -> Result<()> {
+        let _guard = exclusive();
+        check("novas_start_accuracy_monitor", unsafe { sn::novas_start_accuracy_monitor(fraction, queue as _) })
+    }
+
+    /// Stops the monitor, and returns the final statistics.
+    pub fn stop() -> Result<AccuracyStats> {
+        let mut stats = AccuracyStats::default();
+        let _guard = exclusive();
+        check("novas_stop_accuracy_monitor", unsafe {
+            sn::novas_stop_accuracy_monitor(&mut stats as *mut AccuracyStats as *mut sn::novas_accuracy_stats)
+        })?;
+        Ok(stats)
+    }
+
+    /// The statistics since the monitor was started, or last reset.
+    pub fn stats() -> Result<AccuracyStats> {
+        let mut stats = AccuracyStats::default();
+        check("novas_get_accuracy_stats", unsafe {
+            sn::novas_get_accuracy_stats(&mut stats as *mut AccuracyStats as *mut sn::novas_accuracy_stats)
+        })?;
+        Ok(stats)
+    }
+
+    /// Resets the statistics, e.g. when switching to another mode of operation.
+    pub fn reset() -> Result<()> {
+        check("novas_reset_accuracy_stats", unsafe { sn::novas_reset_accuracy_stats() })
+    }
+}
+
+/// Setup of, and queries to, the process-wide ephemeris providers.
+pub struct Ephemeris;
+
+impl Ephemeris {
+    /// Uses CALCEPH with the given ephemeris files for all solar-system bodies. SuperNOVAS opens
+    /// per-thread instances if CALCEPH is not thread-safe for the files, so queries need no lock.
+    pub fn use_calceph<S: AsRef<str>>(files: &[S]) -> Result<()> {
+        let names = c_strings(files)?;
+        let ptrs: Vec<*const c_char> = names.iter().map(|n| n.as_ptr()).collect();
+        let _guard = exclusive();
+        check("novas_use_calceph_files", unsafe { sn::novas_use_calceph_files(ptrs.as_ptr(), ptrs.len() as _) })
+    }
+
+    /// Uses CSPICE for all solar-system bodies, after loading the given kernels.
+    pub fn use_cspice<S: AsRef<str>>(kernels: &[S]) -> Result<()> {
+        let names = c_strings(kernels)?;
+        let _guard = exclusive();
+        for name in &names {
+            check("cspice_add_kernel", unsafe { sn::cspice_add_kernel(name.as_ptr()) })?;
+        }
+        check("novas_use_cspice", unsafe { sn::novas_use_cspice() })
+    }
+
+    /// Prefetches the data of ephemeris objects from the current (slow, e.g. remote) provider on a
+    /// background I/O thread, with nodes every `step` days (or 0 for the default), reading `ahead` nodes
+    /// ahead of the ones in use. Positions are interpolated between the nodes. If `nonblocking`, queries
+    /// for data that has not arrived yet fail immediately, rather than waiting for it.
+    pub fn start_prefetch(step: f64, ahead: usize, nonblocking: bool) -> Result<()> {
+        let mode = if nonblocking {
+            sn::novas_prefetch_mode_NOVAS_PREFETCH_NONBLOCKING
+        } else {
+            sn::novas_prefetch_mode_NOVAS_PREFETCH_BLOCKING
+        };
+        let _guard = exclusive();
+        check("novas_start_prefetch", unsafe { sn::novas_start_prefetch(step, ahead as _, mode) })
+    }
+
+    /// Stops prefetching, and reinstates the original ephemeris provider.
+    pub fn stop_prefetch() -> Result<()> {
+        let _guard = exclusive();
+        check("novas_stop_prefetch", unsafe { sn::novas_stop_prefetch() })
+    }
+
+    /// Hints that the data of `body` will be needed between the TDB-based Julian dates `from` and `to`,
+    /// so it is fetched in the background. Returns immediately.
+    pub fn prefetch(body: &Source, from: f64, to: f64) -> Result<()> {
+        let _guard = shared();
+        check("novas_prefetch", unsafe { sn::novas_prefetch(&body.0, from, to) })
+    }
+
+    /// The number of prefetched nodes that are requested, but not yet available.
+    pub fn prefetch_pending() -> Result<usize> {
+        let _guard = shared();
+        let n = unsafe { sn::novas_prefetch_pending() };
+        if n < 0 { Err(Error::Novas { func: "novas_prefetch_pending", code: n as _ }) } else { Ok(n as usize) }
+    }
+
+    /// The number of NUMA (memory) nodes of the host, or 1 if there is only one (or it is not known).
+    pub fn numa_nodes() -> usize {
+        unsafe { sn::novas_numa_nodes() }.max(1) as usize
+    }
+
+    /// Replicates the CIO locator data in use on every NUMA node, so lookups on multi-socket hosts read
+    /// their local copy. Call it after the locator data is set, and before the calculations start.
+    pub fn replicate_cio() -> Result<()> {
+        let _guard = exclusive();
+        check("novas_replicate_cio_locator", unsafe { sn::novas_replicate_cio_locator() })
+    }
+
+    /// Replicates the packed (shared-memory or subset) ephemeris in use on every NUMA node, so lookups on
+    /// multi-socket hosts read their local copy.
+    pub fn replicate_packed() -> Result<()> {
+        let _guard = exclusive();
+        check("novas_replicate_shm_ephem", unsafe { sn::novas_replicate_shm_ephem() })
+    }
+
+    fn planet_unlocked(provider: sn::novas_planet_provider_hp, body: Planet, origin: Origin, jd_tdb: f64,
+        pos: &mut [f64; 3], vel: &mut [f64; 3]) -> Result<()> {
+        let f = provider.ok_or(Error::Novas { func: "get_planet_provider_hp", code: -1 })?;
+        let jd = [jd_tdb, 0.0];
+        let res = unsafe { f(jd.as_ptr(), body.raw(), origin.raw(), pos.as_mut_ptr(), vel.as_mut_ptr()) };
+        check("planet_provider_hp", res as i32)
+    }
+
+    fn planet_slice(provider: sn::novas_planet_provider_hp, body: Planet, origin: Origin, jd_tdb: &[f64],
+        pos: &mut [[f64; 3]], vel: &mut [[f64; 3]]) -> Result<()> {
+        for ((&jd, p), v) in jd_tdb.iter().zip(pos.iter_mut()).zip(vel.iter_mut()) {
+            Ephemeris::planet_unlocked(provider, body, origin, jd, p, v)?;
+        }
+        Ok(())
+    }
+
+    /// [AU, AU/day] Position and velocity of a major body at a TDB-based Julian date.
+    pub fn planet(body: Planet, origin: Origin, jd_tdb: f64) -> Result<([f64; 3], [f64; 3])> {
+        let (mut pos, mut vel) = ([0.0; 3], [0.0; 3]);
+        let _guard = shared();
+        Ephemeris::planet_unlocked(unsafe { sn::get_planet_provider_hp() }, body, origin, jd_tdb, &mut pos, &mut vel)?;
+        Ok((pos, vel))
+    }
+
+    /// Positions and velocities of a major body at many dates, into `pos` and `vel`, which must
+    /// have the same length as `jd_tdb`.
+    pub fn planet_into(body: Planet, origin: Origin, jd_tdb: &[f64], pos: &mut [[f64; 3]],
+        vel: &mut [[f64; 3]]) -> Result<()> {
+        check_len(jd_tdb.len(), pos.len())?;
+        check_len(jd_tdb.len(), vel.len())?;
+        let _guard = shared();
+        Ephemeris::planet_slice(unsafe { sn::get_planet_provider_hp() }, body, origin, jd_tdb, pos, vel)
+    }
+
+    /// Same as [`Ephemeris::planet_into()`], but on the Rayon pool.
+    #[cfg(feature = "rayon")]
+    pub fn par_planet_into(body: Planet, origin: Origin, jd_tdb: &[f64], pos: &mut [[f64; 3]],
+        vel: &mut [[f64; 3]]) -> Result<()> {
+        check_len(jd_tdb.len(), pos.len())?;
+        check_len(jd_tdb.len(), vel.len())?;
+        let _guard = shared();
+        let provider = unsafe { sn::get_planet_provider_hp() };
+        jd_tdb.par_chunks(PAR_CHUNK).zip(pos.par_chunks_mut(PAR_CHUNK)).zip(vel.par_chunks_mut(PAR_CHUNK))
+            .try_for_each(|((jd, p), v)| Ephemeris::planet_slice(provider, body, origin, jd, p, v))
+    }
+}